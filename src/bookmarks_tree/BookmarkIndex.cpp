@@ -0,0 +1,203 @@
+#include "BookmarkIndex.hpp"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+
+#include <cstring>
+
+namespace
+{
+constexpr char Magic[4] = {'K', 'B', 'T', 'I'};
+constexpr quint32 Version = 1;
+// Texts longer than this are cut; they are only shown, never compared.
+constexpr int MaxTextBytes = 256;
+
+// Reads the index from a mapped buffer, checking every length against what is
+// left of it.
+class Reader
+{
+public:
+    Reader(const uchar *data, qint64 size)
+        : m_data(data)
+        , m_end(data + size)
+    {
+    }
+
+    bool atEnd() const
+    {
+        return m_data == m_end;
+    }
+
+    template<typename T>
+    bool read(T *value)
+    {
+        if (m_end - m_data < qint64(sizeof(T))) {
+            return false;
+        }
+        *value = qFromLittleEndian<T>(m_data);
+        m_data += sizeof(T);
+        return true;
+    }
+
+    // The next length bytes, without copying them.
+    bool readBytes(quint32 length, QByteArray *bytes)
+    {
+        if (quint64(m_end - m_data) < length) {
+            return false;
+        }
+        *bytes = QByteArray::fromRawData(reinterpret_cast<const char *>(m_data), length);
+        m_data += length;
+        return true;
+    }
+
+private:
+    const uchar *m_data;
+    const uchar *m_end;
+};
+
+template<typename T>
+void append(QByteArray &buffer, T value)
+{
+    const auto size = buffer.size();
+    buffer.resize(size + sizeof(T));
+    qToLittleEndian<T>(value, buffer.data() + size);
+}
+
+void appendBytes(QByteArray &buffer, const QByteArray &bytes)
+{
+    append<quint32>(buffer, bytes.size());
+    buffer.append(bytes);
+}
+}
+
+BookmarkIndex::BookmarkIndex(const QString &path)
+    : m_file(path)
+{
+}
+
+BookmarkIndex::~BookmarkIndex()
+{
+    unmap();
+}
+
+QString BookmarkIndex::path() const
+{
+    return m_file.fileName();
+}
+
+QList<BookmarkIndex::File> BookmarkIndex::load()
+{
+    unmap();
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() < qint64(sizeof(Magic))) {
+        m_file.close();
+        return {};
+    }
+    const qint64 size = m_file.size();
+    m_map = m_file.map(0, size);
+    // The mapping outlives the descriptor.
+    m_file.close();
+    if (!m_map) {
+        return {};
+    }
+
+    QList<File> files;
+    Reader reader(m_map + sizeof(Magic), size - sizeof(Magic));
+    quint32 version = 0;
+    quint32 fileCount = 0;
+    if (std::memcmp(m_map, Magic, sizeof(Magic)) != 0 || !reader.read(&version) || version != Version || !reader.read(&fileCount)) {
+        return {};
+    }
+    for (quint32 i = 0; i < fileCount; ++i) {
+        File file;
+        quint32 urlLength = 0;
+        QByteArray url;
+        quint32 bookmarkCount = 0;
+        if (!reader.read(&urlLength) || !reader.readBytes(urlLength, &url) || !reader.read(&bookmarkCount)) {
+            return {};
+        }
+        file.url = QString::fromUtf8(url);
+        for (quint32 j = 0; j < bookmarkCount; ++j) {
+            Bookmark bookmark;
+            quint32 line = 0;
+            quint32 textLength = 0;
+            if (!reader.read(&line) || !reader.read(&bookmark.hash) || !reader.read(&textLength) || !reader.readBytes(textLength, &bookmark.text)) {
+                return {};
+            }
+            bookmark.line = int(line);
+            file.bookmarks.append(bookmark);
+        }
+        files.append(file);
+    }
+    if (!reader.atEnd()) {
+        return {};
+    }
+    return files;
+}
+
+bool BookmarkIndex::save(const QList<File> &files)
+{
+    // On some systems a mapped file cannot be replaced.
+    if (m_map) {
+        return false;
+    }
+
+    QByteArray buffer(Magic, sizeof(Magic));
+    append<quint32>(buffer, Version);
+    append<quint32>(buffer, files.size());
+    for (const auto &file : files) {
+        appendBytes(buffer, file.url.toUtf8());
+        append<quint32>(buffer, file.bookmarks.size());
+        for (const auto &bookmark : file.bookmarks) {
+            append<quint32>(buffer, bookmark.line);
+            append<quint64>(buffer, bookmark.hash);
+            appendBytes(buffer, bookmark.text);
+        }
+    }
+
+    QDir().mkpath(QFileInfo(m_file.fileName()).absolutePath());
+    QSaveFile out(m_file.fileName());
+    if (!out.open(QIODevice::WriteOnly) || out.write(buffer) != buffer.size()) {
+        return false;
+    }
+    return out.commit();
+}
+
+void BookmarkIndex::unmap()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+}
+
+// FNV-1a over the UTF-8 of the trimmed text, so that it is the same from one
+// run (and Qt version) to the next, unlike qHash().
+quint64 BookmarkIndex::lineHash(const QString &text)
+{
+    quint64 hash = 14695981039346656037ULL;
+    const auto bytes = text.trimmed().toUtf8();
+    for (auto byte : bytes) {
+        hash ^= uchar(byte);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+BookmarkIndex::Bookmark BookmarkIndex::bookmark(int line, const QString &text)
+{
+    Bookmark bookmark;
+    bookmark.line = line;
+    bookmark.hash = lineHash(text);
+    bookmark.text = text.trimmed().toUtf8();
+    if (bookmark.text.size() > MaxTextBytes) {
+        // Not within a multi-byte character.
+        int size = MaxTextBytes;
+        while (size > 0 && (uchar(bookmark.text.at(size)) & 0xC0) == 0x80) {
+            --size;
+        }
+        bookmark.text.truncate(size);
+    }
+    return bookmark;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QString>
+
+// The bookmarks of all files as last seen, kept on disk so that bookmarks of
+// files that are not open can be listed (and opened) without opening them.
+//
+// The index is one little-endian binary file:
+//
+//   "KBTI" version:u32 fileCount:u32
+//   per file:     urlLength:u32 url:utf8 bookmarkCount:u32
+//   per bookmark: line:u32 hash:u64 textLength:u32 text:utf8
+//
+// load() maps it into memory and hands out bookmark texts that point into the
+// mapping rather than copies; they stay valid until unmap().
+class BookmarkIndex
+{
+public:
+    struct Bookmark {
+        int line = 0;
+        // lineHash() of the line's text, to find the line again after the
+        // file was changed elsewhere.
+        quint64 hash = 0;
+        // The start of the line, trimmed, as shown while the file is closed.
+        QByteArray text;
+    };
+    struct File {
+        QString url;
+        QList<Bookmark> bookmarks;
+    };
+
+    explicit BookmarkIndex(const QString &path);
+    ~BookmarkIndex();
+
+    QString path() const;
+
+    // The files in the index, or none if there is no (readable) index.
+    QList<File> load();
+    // Replaces the index with files. Fails while the index is mapped.
+    bool save(const QList<File> &files);
+    // Drops the mapping; texts handed out by load() must be detached first.
+    void unmap();
+
+    static quint64 lineHash(const QString &text);
+    static Bookmark bookmark(int line, const QString &text);
+
+private:
+    QFile m_file;
+    uchar *m_map = nullptr;
+};
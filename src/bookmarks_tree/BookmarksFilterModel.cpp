@@ -0,0 +1,166 @@
+#include "BookmarksFilterModel.hpp"
+#include "BookmarksModel.hpp"
+
+#include <KFuzzyMatcher>
+
+#include <algorithm>
+
+BookmarksFilterModel::BookmarksFilterModel(BookmarksModel *model, QObject *parent)
+    : QSortFilterProxyModel(parent)
+    , m_model(model)
+{
+    setSourceModel(model);
+
+    // The scores go out of date with the source; a burst of changes scores
+    // once.
+    m_rescoreTimer.setSingleShot(true);
+    m_rescoreTimer.setInterval(0);
+    connect(&m_rescoreTimer, &QTimer::timeout, this, &BookmarksFilterModel::rescore);
+    connect(model, &QAbstractItemModel::rowsInserted, this, &BookmarksFilterModel::sourceChanged);
+    connect(model, &QAbstractItemModel::rowsRemoved, this, &BookmarksFilterModel::sourceChanged);
+    connect(model, &QAbstractItemModel::modelReset, this, &BookmarksFilterModel::sourceChanged);
+    connect(model, &QAbstractItemModel::dataChanged, this, &BookmarksFilterModel::sourceChanged);
+}
+
+QString BookmarksFilterModel::pattern() const
+{
+    return m_pattern;
+}
+
+void BookmarksFilterModel::setPattern(const QString &pattern)
+{
+    if (pattern == m_pattern) {
+        return;
+    }
+    const bool narrowing = !m_stale && !m_pattern.isEmpty() && pattern.startsWith(m_pattern);
+    m_pattern = pattern;
+    if (m_pattern.isEmpty()) {
+        m_fileScores.clear();
+        m_fileNameScores.clear();
+        m_bookmarkScores.clear();
+        invalidateRowsFilter();
+        // Back to the order of the source.
+        sort(-1);
+        return;
+    }
+    scoreAll(narrowing);
+    invalidate();
+    sort(0);
+}
+
+void BookmarksFilterModel::sourceChanged()
+{
+    if (m_pattern.isEmpty()) {
+        return;
+    }
+    m_stale = true;
+    m_rescoreTimer.start();
+}
+
+void BookmarksFilterModel::rescore()
+{
+    if (m_pattern.isEmpty()) {
+        return;
+    }
+    scoreAll(false);
+    invalidate();
+}
+
+void BookmarksFilterModel::scoreAll(bool narrowing)
+{
+    const int fileCount = m_model->rowCount();
+    if (!narrowing) {
+        m_fileScores.fill(0, fileCount);
+        m_fileNameScores.fill(0, fileCount);
+        m_bookmarkScores.resize(fileCount);
+    }
+    for (int fileRow = 0; fileRow < fileCount; ++fileRow) {
+        if (m_fileScores[fileRow] < 0) {
+            continue;
+        }
+        const auto fileIndex = m_model->index(fileRow, 0);
+        const int nameScore = m_fileNameScores[fileRow] < 0 ? -1 : match(fileIndex);
+        int best = nameScore;
+        auto &scores = m_bookmarkScores[fileRow];
+        const int count = m_model->rowCount(fileIndex);
+        if (!narrowing) {
+            scores.fill(0, count);
+        }
+        for (int row = 0; row < count; ++row) {
+            if (scores[row] < 0) {
+                continue;
+            }
+            scores[row] = match(m_model->index(row, 0, fileIndex));
+            best = std::max(best, scores[row]);
+        }
+        m_fileNameScores[fileRow] = nameScore;
+        m_fileScores[fileRow] = best;
+    }
+    m_stale = false;
+}
+
+// The score of the source row at index against the pattern, or -1.
+int BookmarksFilterModel::match(const QModelIndex &index) const
+{
+    const auto result = KFuzzyMatcher::match(m_pattern, m_model->searchText(index));
+    return result.matched ? std::max(0, result.score) : -1;
+}
+
+int BookmarksFilterModel::fileScore(int fileRow) const
+{
+    if (!m_stale) {
+        return m_fileScores.value(fileRow, -1);
+    }
+    const auto fileIndex = m_model->index(fileRow, 0);
+    int best = match(fileIndex);
+    const int count = m_model->rowCount(fileIndex);
+    for (int row = 0; row < count; ++row) {
+        best = std::max(best, match(m_model->index(row, 0, fileIndex)));
+    }
+    return best;
+}
+
+bool BookmarksFilterModel::fileNameMatches(int fileRow) const
+{
+    if (!m_stale) {
+        return m_fileNameScores.value(fileRow, -1) >= 0;
+    }
+    return match(m_model->index(fileRow, 0)) >= 0;
+}
+
+int BookmarksFilterModel::bookmarkScore(int fileRow, int row) const
+{
+    if (!m_stale) {
+        return m_bookmarkScores.value(fileRow).value(row, -1);
+    }
+    return match(m_model->index(row, 0, m_model->index(fileRow, 0)));
+}
+
+bool BookmarksFilterModel::filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const
+{
+    if (m_pattern.isEmpty()) {
+        return true;
+    }
+    if (!sourceParent.isValid()) {
+        return fileScore(sourceRow) >= 0;
+    }
+    return fileNameMatches(sourceParent.row()) || bookmarkScore(sourceParent.row(), sourceRow) >= 0;
+}
+
+// Better matches first, else in the order of the source.
+bool BookmarksFilterModel::lessThan(const QModelIndex &left, const QModelIndex &right) const
+{
+    int leftScore = 0;
+    int rightScore = 0;
+    if (!left.parent().isValid()) {
+        leftScore = fileScore(left.row());
+        rightScore = fileScore(right.row());
+    } else {
+        leftScore = bookmarkScore(left.parent().row(), left.row());
+        rightScore = bookmarkScore(right.parent().row(), right.row());
+    }
+    if (leftScore != rightScore) {
+        return leftScore > rightScore;
+    }
+    return left.row() < right.row();
+}
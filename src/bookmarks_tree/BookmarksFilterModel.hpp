@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QList>
+#include <QSortFilterProxyModel>
+#include <QTimer>
+
+class BookmarksModel;
+
+// Filters the bookmark tree of one window by a fuzzy pattern, matched against
+// file names and bookmark texts (see BookmarksModel::searchText()), and ranks
+// what is left by how well it matches. A file is shown with all its bookmarks
+// when its name matches, else with the bookmarks that match.
+//
+// Scores are computed once per pattern rather than per filterAcceptsRow()
+// call. A pattern that extends the previous one only scores again the rows
+// that matched that one, since nothing else can match it.
+class BookmarksFilterModel : public QSortFilterProxyModel
+{
+    Q_OBJECT
+public:
+    explicit BookmarksFilterModel(BookmarksModel *model, QObject *parent = nullptr);
+
+    QString pattern() const;
+
+public Q_SLOTS:
+    void setPattern(const QString &pattern);
+
+protected:
+    bool filterAcceptsRow(int sourceRow, const QModelIndex &sourceParent) const override;
+    bool lessThan(const QModelIndex &left, const QModelIndex &right) const override;
+
+private:
+    void scoreAll(bool narrowing);
+    void sourceChanged();
+    void rescore();
+    int match(const QModelIndex &index) const;
+    int fileScore(int fileRow) const;
+    bool fileNameMatches(int fileRow) const;
+    int bookmarkScore(int fileRow, int row) const;
+
+    BookmarksModel *m_model = nullptr;
+    QString m_pattern;
+    // By source row; -1 for rows that do not match. The score of a file is
+    // the best of its name and bookmarks.
+    QList<int> m_fileScores;
+    QList<int> m_fileNameScores;
+    QList<QList<int>> m_bookmarkScores;
+    // Set while the source changed since the scores were computed; rows are
+    // then matched as they are asked for until the scores are computed again.
+    bool m_stale = false;
+    QTimer m_rescoreTimer;
+};
@@ -0,0 +1,761 @@
+#include "BookmarksModel.hpp"
+
+#include <KTextEditor/Application>
+#include <KTextEditor/Cursor>
+#include <KTextEditor/Document>
+#include <KTextEditor/Editor>
+#include <KTextEditor/MovingCursor>
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QIcon>
+#include <QPair>
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+// How far from its saved line a bookmark of a file changed elsewhere is looked
+// for by its text.
+constexpr int RestoreSearchLines = 100;
+}
+
+BookmarksModel::BookmarksModel(const QString &indexPath, QObject *parent)
+    : QAbstractItemModel(parent)
+    , m_index(indexPath)
+{
+    m_refreshTimer.setSingleShot(true);
+    m_refreshTimer.setInterval(0);
+    connect(&m_refreshTimer, &QTimer::timeout, this, &BookmarksModel::flushPendingRefreshes);
+    m_saveTimer.setSingleShot(true);
+    m_saveTimer.setInterval(2000);
+    connect(&m_saveTimer, &QTimer::timeout, this, &BookmarksModel::saveIndex);
+    m_changedTimer.setSingleShot(true);
+    m_changedTimer.setInterval(300);
+    connect(&m_changedTimer, &QTimer::timeout, this, &BookmarksModel::flushEditedDocuments);
+
+    auto app = KTextEditor::Editor::instance()->application();
+    connect(app, &KTextEditor::Application::documentCreated, this, &BookmarksModel::connectDocument);
+    connect(app, &KTextEditor::Application::documentWillBeDeleted, this, &BookmarksModel::closeDocument);
+    for (auto document : app->documents()) {
+        connectDocument(document);
+    }
+}
+
+BookmarksModel::~BookmarksModel()
+{
+    saveIndex();
+}
+
+void BookmarksModel::populate()
+{
+    if (m_populated) {
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    m_populated = true;
+    loadIndex();
+    const int indexed = int(m_files.size());
+    const int documents = int(m_pendingDocuments.size());
+    m_refreshTimer.stop();
+    flushPendingRefreshes();
+    qInfo() << "[bookmarks] Read" << indexed << "indexed files and" << documents << "documents in" << timer.elapsed() << "ms";
+}
+
+bool BookmarksModel::isPopulated() const
+{
+    return m_populated;
+}
+
+QModelIndex BookmarksModel::index(int row, int column, const QModelIndex &parent) const
+{
+    if (!hasIndex(row, column, parent)) {
+        return QModelIndex();
+    }
+    if (!parent.isValid()) {
+        return createIndex(row, column, nullptr);
+    }
+    return createIndex(row, column, m_files[parent.row()].get());
+}
+
+QModelIndex BookmarksModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid() || !child.internalPointer()) {
+        return QModelIndex();
+    }
+    return createIndex(fileRow(static_cast<const BookmarkFile *>(child.internalPointer())), 0, nullptr);
+}
+
+int BookmarksModel::rowCount(const QModelIndex &parent) const
+{
+    if (!parent.isValid()) {
+        return int(m_files.size());
+    }
+    if (parent.internalPointer() || parent.column() != 0) {
+        return 0;
+    }
+    return bookmarkCount(*m_files[parent.row()]);
+}
+
+int BookmarksModel::columnCount(const QModelIndex &) const
+{
+    return 1;
+}
+
+QVariant BookmarksModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) {
+        return QVariant();
+    }
+    auto bookmarkFile = static_cast<const BookmarkFile *>(index.internalPointer());
+    if (!bookmarkFile) {
+        const auto &file = *m_files[index.row()];
+        switch (role) {
+        case Qt::DisplayRole:
+            return file.url.fileName();
+        case Qt::ToolTipRole:
+            if (!file.document) {
+                return tr("%1 (not open)").arg(file.url.toDisplayString(QUrl::PreferLocalFile));
+            }
+            return file.url.toDisplayString(QUrl::PreferLocalFile);
+        case Qt::DecorationRole:
+            return QIcon::fromTheme(QStringLiteral("document-multiple"));
+        case DocumentRole:
+            return QVariant::fromValue(file.document);
+        case LineRole:
+            return -1;
+        case UrlRole:
+            return file.url;
+        }
+        return QVariant();
+    }
+
+    // The text of an open document is read when shown, so that it follows
+    // edits to the line.
+    int line = 0;
+    QString text;
+    if (bookmarkFile->document) {
+        line = bookmarkFile->bookmarks[index.row()]->line();
+        if (role == Qt::DisplayRole) {
+            text = bookmarkFile->document->line(line).trimmed();
+        }
+    } else {
+        const auto &bookmark = bookmarkFile->stored[index.row()];
+        line = bookmark.line;
+        if (role == Qt::DisplayRole) {
+            text = QString::fromUtf8(bookmark.text);
+        }
+    }
+    switch (role) {
+    case Qt::DisplayRole:
+        return QStringLiteral("%1: %2").arg(line + 1).arg(text);
+    case Qt::DecorationRole:
+        return QIcon::fromTheme(QStringLiteral("bookmarks"));
+    case DocumentRole:
+        return QVariant::fromValue(bookmarkFile->document);
+    case LineRole:
+        return line;
+    case UrlRole:
+        return bookmarkFile->url;
+    }
+    return QVariant();
+}
+
+QVariant BookmarksModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (section == 0 && orientation == Qt::Horizontal && role == Qt::DisplayRole) {
+        return tr("Bookmarks");
+    }
+    return QVariant();
+}
+
+KTextEditor::Document *BookmarksModel::document(const QModelIndex &index) const
+{
+    return index.data(DocumentRole).value<KTextEditor::Document *>();
+}
+
+int BookmarksModel::line(const QModelIndex &index) const
+{
+    return index.isValid() ? index.data(LineRole).toInt() : -1;
+}
+
+QUrl BookmarksModel::url(const QModelIndex &index) const
+{
+    return index.data(UrlRole).toUrl();
+}
+
+QString BookmarksModel::searchText(const QModelIndex &index) const
+{
+    if (!index.isValid()) {
+        return QString();
+    }
+    auto file = static_cast<const BookmarkFile *>(index.internalPointer());
+    if (!file) {
+        return m_files[index.row()]->url.fileName();
+    }
+
+    if (file->document && m_editedDocuments.remove(file->document)) {
+        file->textsStale = true;
+    }
+    if (file->textsStale) {
+        file->texts.clear();
+        if (file->document) {
+            for (const auto &cursor : file->bookmarks) {
+                file->texts.append(file->document->line(cursor->line()).trimmed());
+            }
+        } else {
+            for (const auto &bookmark : file->stored) {
+                file->texts.append(QString::fromUtf8(bookmark.text));
+            }
+        }
+        file->textsStale = false;
+    }
+    return file->texts.at(index.row());
+}
+
+int BookmarksModel::bookmarkCount(const BookmarkFile &file)
+{
+    return file.document ? int(file.bookmarks.size()) : int(file.stored.size());
+}
+
+int BookmarksModel::bookmarkLine(const BookmarkFile &file, int row)
+{
+    return file.document ? file.bookmarks[row]->line() : file.stored[row].line;
+}
+
+int BookmarksModel::upperBookmarkRow(const BookmarkFile &file, int line)
+{
+    int first = 0;
+    int count = bookmarkCount(file);
+    while (count > 0) {
+        const int step = count / 2;
+        if (bookmarkLine(file, first + step) <= line) {
+            first += step + 1;
+            count -= step + 1;
+        } else {
+            count = step;
+        }
+    }
+    return first;
+}
+
+int BookmarksModel::lowerBookmarkRow(const BookmarkFile &file, int line)
+{
+    return upperBookmarkRow(file, line - 1);
+}
+
+QModelIndex BookmarksModel::nextBookmark(const QUrl &url, int line) const
+{
+    if (m_files.empty()) {
+        return QModelIndex();
+    }
+    int row = sortedFileRow(url);
+    if (row < int(m_files.size()) && m_files[row]->url == url) {
+        const int next = upperBookmarkRow(*m_files[row], line);
+        if (next < bookmarkCount(*m_files[row])) {
+            return index(next, 0, index(row, 0));
+        }
+        ++row;
+    }
+    row %= int(m_files.size());
+    return index(0, 0, index(row, 0));
+}
+
+QModelIndex BookmarksModel::previousBookmark(const QUrl &url, int line) const
+{
+    if (m_files.empty()) {
+        return QModelIndex();
+    }
+    // The files before row sort before url.
+    int row = sortedFileRow(url);
+    if (row < int(m_files.size()) && m_files[row]->url == url) {
+        const int previous = lowerBookmarkRow(*m_files[row], line) - 1;
+        if (previous >= 0) {
+            return index(previous, 0, index(row, 0));
+        }
+    }
+    row = (row + int(m_files.size()) - 1) % int(m_files.size());
+    return index(bookmarkCount(*m_files[row]) - 1, 0, index(row, 0));
+}
+
+void BookmarksModel::connectDocument(KTextEditor::Document *document)
+{
+    connect(document, &KTextEditor::Document::markChanged, this, [this](KTextEditor::Document *document, auto, auto) {
+        scheduleRefresh(document);
+    });
+    // The position of a document among the others follows its URL; a file
+    // being opened gets its URL once loaded.
+    connect(document, &KTextEditor::Document::documentUrlChanged, this, &BookmarksModel::scheduleRefresh);
+    connect(document, &KTextEditor::Document::textChanged, this, [this](KTextEditor::Document *document) {
+        m_editedDocuments.insert(document);
+        m_changedDocuments.insert(document);
+        if (!m_changedTimer.isActive()) {
+            m_changedTimer.start();
+        }
+    });
+    // The cursors go before the document's text does; on reload, the marks
+    // are read again afterwards.
+    connect(document, &KTextEditor::Document::aboutToDeleteMovingInterfaceContent, this, &BookmarksModel::removeDocument);
+    connect(document, &KTextEditor::Document::aboutToInvalidateMovingInterfaceContent, this, [this](KTextEditor::Document *document) {
+        removeDocument(document);
+        scheduleRefresh(document);
+    });
+    scheduleRefresh(document);
+}
+
+void BookmarksModel::removeDocument(KTextEditor::Document *document)
+{
+    m_pendingDocuments.remove(document);
+    m_editedDocuments.remove(document);
+    m_changedDocuments.remove(document);
+    const int row = fileRow(document);
+    if (row >= 0) {
+        removeFile(row);
+    }
+}
+
+// Keeps the bookmarks of a document that is being closed, as a closed file.
+void BookmarksModel::closeDocument(KTextEditor::Document *document)
+{
+    // Its bookmarks are to go into the index.
+    populate();
+    m_pendingDocuments.remove(document);
+    m_editedDocuments.remove(document);
+    m_changedDocuments.remove(document);
+    const int row = fileRow(document);
+    if (row < 0) {
+        return;
+    }
+    auto file = m_files[row].get();
+    QList<BookmarkIndex::Bookmark> stored;
+    for (const auto &cursor : file->bookmarks) {
+        stored.append(BookmarkIndex::bookmark(cursor->line(), document->line(cursor->line())));
+    }
+
+    beginRemoveRows(index(row, 0), 0, int(file->bookmarks.size()) - 1);
+    file->bookmarks.clear();
+    file->document = nullptr;
+    endRemoveRows();
+    setStoredBookmarks(row, stored);
+    m_saveTimer.start();
+}
+
+void BookmarksModel::scheduleRefresh(KTextEditor::Document *document)
+{
+    m_pendingDocuments.insert(document);
+    if (m_populated && m_bulkUpdates == 0) {
+        m_refreshTimer.start();
+    }
+}
+
+void BookmarksModel::beginBulkUpdate()
+{
+    ++m_bulkUpdates;
+}
+
+void BookmarksModel::endBulkUpdate()
+{
+    if (--m_bulkUpdates == 0 && m_populated) {
+        m_refreshTimer.stop();
+        flushPendingRefreshes();
+    }
+}
+
+void BookmarksModel::flushPendingRefreshes()
+{
+    const auto documents = std::exchange(m_pendingDocuments, {});
+    for (auto document : documents) {
+        refreshBookmarks(document);
+    }
+    if (!documents.isEmpty()) {
+        m_saveTimer.start();
+    }
+}
+
+// Tells views and filters that the lines of the bookmarks of the documents
+// edited since the last time may read differently now.
+void BookmarksModel::flushEditedDocuments()
+{
+    const auto documents = std::exchange(m_changedDocuments, {});
+    for (auto document : documents) {
+        const int row = fileRow(document);
+        if (row < 0 || m_files[row]->bookmarks.empty()) {
+            continue;
+        }
+        const auto parent = index(row, 0);
+        Q_EMIT dataChanged(index(0, 0, parent), index(int(m_files[row]->bookmarks.size()) - 1, 0, parent), {Qt::DisplayRole});
+    }
+}
+
+// Reads the marks of every open document again; closed files stay as they
+// are.
+void BookmarksModel::refreshAll()
+{
+    populate();
+    m_refreshTimer.stop();
+    m_pendingDocuments.clear();
+    beginResetModel();
+    m_files.erase(std::remove_if(m_files.begin(),
+                                 m_files.end(),
+                                 [](const auto &file) {
+                                     return file->document != nullptr;
+                                 }),
+                  m_files.end());
+    const auto documents = KTextEditor::Editor::instance()->documents();
+    for (auto document : documents) {
+        // Documents without a file to open are not listed.
+        const auto lines = document->url().isValid() ? bookmarkLines(document) : QList<int>();
+        if (lines.isEmpty()) {
+            continue;
+        }
+        const int closedRow = closedFileRow(document->url());
+        if (closedRow >= 0) {
+            m_files.erase(m_files.begin() + closedRow);
+        }
+        auto file = std::make_unique<BookmarkFile>();
+        file->document = document;
+        file->url = document->url();
+        setBookmarks(file.get(), lines);
+        m_files.insert(m_files.begin() + sortedFileRow(file->url), std::move(file));
+    }
+    renumberFiles(0);
+    endResetModel();
+    m_saveTimer.start();
+}
+
+int BookmarksModel::fileRow(const KTextEditor::Document *document) const
+{
+    if (!document) {
+        return -1;
+    }
+    auto it = std::find_if(m_files.begin(), m_files.end(), [document](const auto &file) {
+        return file->document == document;
+    });
+    return it == m_files.end() ? -1 : int(it - m_files.begin());
+}
+
+int BookmarksModel::fileRow(const BookmarkFile *file) const
+{
+    return file->row;
+}
+
+// The row of the closed file at url, if the index has bookmarks for it.
+int BookmarksModel::closedFileRow(const QUrl &url) const
+{
+    for (int row = sortedFileRow(url); row < int(m_files.size()) && m_files[row]->url == url; ++row) {
+        if (!m_files[row]->document) {
+            return row;
+        }
+    }
+    return -1;
+}
+
+// The row at which the file at url goes among the files.
+int BookmarksModel::sortedFileRow(const QUrl &url) const
+{
+    auto it = std::lower_bound(m_files.begin(), m_files.end(), url, [](const auto &file, const QUrl &url) {
+        return file->url < url;
+    });
+    return int(it - m_files.begin());
+}
+
+void BookmarksModel::renumberFiles(int row)
+{
+    for (; row < int(m_files.size()); ++row) {
+        m_files[row]->row = row;
+    }
+}
+
+QList<int> BookmarksModel::bookmarkLines(KTextEditor::Document *document)
+{
+    QList<int> lines;
+    const auto marks = document->marks();
+    for (auto mark : marks) {
+        if (mark->type & KTextEditor::Document::Bookmark) {
+            lines.append(mark->line);
+        }
+    }
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+void BookmarksModel::setBookmarks(BookmarkFile *file, const QList<int> &lines)
+{
+    file->bookmarks.clear();
+    file->bookmarks.reserve(lines.size());
+    file->textsStale = true;
+    for (auto line : lines) {
+        file->bookmarks.emplace_back(file->document->newMovingCursor(KTextEditor::Cursor(line, 0)));
+    }
+}
+
+void BookmarksModel::removeFile(int row)
+{
+    beginRemoveRows(QModelIndex(), row, row);
+    m_files.erase(m_files.begin() + row);
+    renumberFiles(row);
+    endRemoveRows();
+}
+
+// Replaces the bookmarks of the closed file at row, dropping the file when
+// none are left.
+void BookmarksModel::setStoredBookmarks(int row, const QList<BookmarkIndex::Bookmark> &stored)
+{
+    if (stored.isEmpty()) {
+        removeFile(row);
+        return;
+    }
+    auto file = m_files[row].get();
+    const auto parent = index(row, 0);
+    if (!file->stored.isEmpty()) {
+        beginRemoveRows(parent, 0, int(file->stored.size()) - 1);
+        file->stored.clear();
+        endRemoveRows();
+    }
+    beginInsertRows(parent, 0, int(stored.size()) - 1);
+    file->stored = stored;
+    file->textsStale = true;
+    endInsertRows();
+}
+
+// Sets the bookmarks a file had when it was closed on its document, each on
+// the line nearest to where it was that still has the same text, else where
+// it was. Returns the lines set.
+QList<int> BookmarksModel::restoreBookmarks(KTextEditor::Document *document, const QList<BookmarkIndex::Bookmark> &stored)
+{
+    const int lineCount = document->lines();
+    QHash<int, quint64> hashes;
+    auto lineHash = [&](int line) {
+        auto it = hashes.find(line);
+        if (it == hashes.end()) {
+            it = hashes.insert(line, BookmarkIndex::lineHash(document->line(line)));
+        }
+        return *it;
+    };
+
+    QList<int> lines;
+    for (const auto &bookmark : stored) {
+        int found = -1;
+        for (int distance = 0; distance <= RestoreSearchLines && found < 0; ++distance) {
+            for (int line : {bookmark.line - distance, bookmark.line + distance}) {
+                if (line >= 0 && line < lineCount && lineHash(line) == bookmark.hash) {
+                    found = line;
+                    break;
+                }
+            }
+        }
+        if (found < 0 && bookmark.line < lineCount) {
+            found = bookmark.line;
+        }
+        if (found >= 0 && !lines.contains(found)) {
+            lines.append(found);
+        }
+    }
+
+    // The mark changes this causes need no update of their own; the caller
+    // lists the lines returned.
+    ++m_bulkUpdates;
+    for (auto line : std::as_const(lines)) {
+        document->addMark(line, KTextEditor::Document::Bookmark);
+    }
+    m_pendingDocuments.remove(document);
+    --m_bulkUpdates;
+
+    std::sort(lines.begin(), lines.end());
+    return lines;
+}
+
+// Updates the rows of one document, leaving those of the others alone.
+void BookmarksModel::refreshBookmarks(KTextEditor::Document *document)
+{
+    const bool valid = document->url().isValid();
+    auto lines = valid ? bookmarkLines(document) : QList<int>();
+    int row = fileRow(document);
+    if (row >= 0 && (lines.isEmpty() || m_files[row]->url != document->url())) {
+        removeFile(row);
+        row = -1;
+    }
+
+    // A file the index has bookmarks for has been opened; from now on it is
+    // listed as a document.
+    const int closedRow = valid ? closedFileRow(document->url()) : -1;
+    if (closedRow >= 0) {
+        const auto stored = m_files[closedRow]->stored;
+        removeFile(closedRow);
+        if (lines.isEmpty()) {
+            lines = restoreBookmarks(document, stored);
+        }
+    }
+    if (lines.isEmpty()) {
+        return;
+    }
+
+    if (row < 0) {
+        auto file = std::make_unique<BookmarkFile>();
+        file->document = document;
+        file->url = document->url();
+        row = sortedFileRow(file->url);
+        beginInsertRows(QModelIndex(), row, row);
+        setBookmarks(file.get(), lines);
+        m_files.insert(m_files.begin() + row, std::move(file));
+        renumberFiles(row);
+        endInsertRows();
+        return;
+    }
+
+    // The document keeps its row, so that views keep it expanded or selected.
+    auto file = m_files[row].get();
+    const auto parent = index(row, 0);
+    if (!file->bookmarks.empty()) {
+        beginRemoveRows(parent, 0, int(file->bookmarks.size()) - 1);
+        file->bookmarks.clear();
+        endRemoveRows();
+    }
+    beginInsertRows(parent, 0, int(lines.size()) - 1);
+    setBookmarks(file, lines);
+    endInsertRows();
+}
+
+void BookmarksModel::loadIndex()
+{
+    const auto files = m_index.load();
+    for (const auto &indexed : files) {
+        if (indexed.bookmarks.isEmpty()) {
+            continue;
+        }
+        auto file = std::make_unique<BookmarkFile>();
+        file->url = QUrl(indexed.url);
+        file->stored = indexed.bookmarks;
+        m_files.insert(m_files.begin() + sortedFileRow(file->url), std::move(file));
+    }
+    renumberFiles(0);
+}
+
+void BookmarksModel::saveIndex()
+{
+    m_saveTimer.stop();
+    // Without the index read, there is nothing to replace it with.
+    if (!m_populated) {
+        return;
+    }
+    QList<BookmarkIndex::File> files;
+    files.reserve(m_files.size());
+    for (const auto &file : m_files) {
+        BookmarkIndex::File indexed;
+        indexed.url = file->url.toString();
+        if (file->document) {
+            for (const auto &cursor : file->bookmarks) {
+                indexed.bookmarks.append(BookmarkIndex::bookmark(cursor->line(), file->document->line(cursor->line())));
+            }
+        } else {
+            // The texts read from the index point into its mapping, which has
+            // to go before the index can be replaced.
+            for (auto &bookmark : file->stored) {
+                bookmark.text = QByteArray(bookmark.text.constData(), bookmark.text.size());
+            }
+            indexed.bookmarks = file->stored;
+        }
+        files.append(indexed);
+    }
+    m_index.unmap();
+    m_index.save(files);
+}
+
+void BookmarksModel::clearAll()
+{
+    populate();
+    beginBulkUpdate();
+    const auto documents = KTextEditor::Editor::instance()->documents();
+    for (auto document : documents) {
+        clearBookmarks(document);
+    }
+    for (int row = int(m_files.size()) - 1; row >= 0; --row) {
+        if (!m_files[row]->document) {
+            removeFile(row);
+        }
+    }
+    m_saveTimer.start();
+    endBulkUpdate();
+}
+
+// Removes the bookmarks of document, leaving its other marks alone.
+void BookmarksModel::clearBookmarks(KTextEditor::Document *document)
+{
+    if (!document) {
+        return;
+    }
+    const auto lines = bookmarkLines(document);
+    beginBulkUpdate();
+    for (auto line : lines) {
+        document->removeMark(line, KTextEditor::Document::Bookmark);
+    }
+    endBulkUpdate();
+}
+
+void BookmarksModel::removeBookmarks(const QModelIndexList &indexes)
+{
+    populate();
+    // Rows change with the first removal; what they stand for is read up front.
+    QList<KTextEditor::Document *> documents;
+    QList<QPair<KTextEditor::Document *, int>> bookmarks;
+    QSet<const BookmarkFile *> closedFiles;
+    QHash<const BookmarkFile *, QSet<int>> closedBookmarks;
+    for (const auto &index : indexes) {
+        auto file = static_cast<const BookmarkFile *>(index.internalPointer());
+        if (!file && !m_files[index.row()]->document) {
+            closedFiles.insert(m_files[index.row()].get());
+        } else if (file && !file->document) {
+            closedBookmarks[file].insert(index.row());
+        } else if (file) {
+            bookmarks.append({file->document, line(index)});
+        } else {
+            documents.append(m_files[index.row()]->document);
+        }
+    }
+
+    beginBulkUpdate();
+    for (const auto &[document, line] : std::as_const(bookmarks)) {
+        document->removeMark(line, KTextEditor::Document::Bookmark);
+    }
+    for (auto document : std::as_const(documents)) {
+        clearBookmarks(document);
+    }
+    for (auto it = closedBookmarks.cbegin(); it != closedBookmarks.cend(); ++it) {
+        if (closedFiles.contains(it.key())) {
+            continue;
+        }
+        QList<BookmarkIndex::Bookmark> stored;
+        for (int i = 0; i < it.key()->stored.size(); ++i) {
+            if (!it.value().contains(i)) {
+                stored.append(it.key()->stored.at(i));
+            }
+        }
+        setStoredBookmarks(fileRow(it.key()), stored);
+    }
+    for (auto file : std::as_const(closedFiles)) {
+        removeFile(fileRow(file));
+    }
+    if (!closedFiles.isEmpty() || !closedBookmarks.isEmpty()) {
+        m_saveTimer.start();
+    }
+    endBulkUpdate();
+}
+
+void BookmarksModel::toggleBookmarks(KTextEditor::Document *document, const QList<int> &lines)
+{
+    if (!document) {
+        return;
+    }
+    beginBulkUpdate();
+    for (auto line : lines) {
+        if (document->mark(line) & KTextEditor::Document::Bookmark) {
+            document->removeMark(line, KTextEditor::Document::Bookmark);
+        } else {
+            document->addMark(line, KTextEditor::Document::Bookmark);
+        }
+    }
+    endBulkUpdate();
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "BookmarkIndex.hpp"
+
+#include <QAbstractItemModel>
+#include <QList>
+#include <QSet>
+#include <QTimer>
+#include <QUrl>
+
+#include <memory>
+#include <vector>
+
+namespace KTextEditor
+{
+class Document;
+class MovingCursor;
+}
+
+// The bookmarks of all files, one top-level row per file with bookmarks
+// (sorted by URL) and one child row per bookmark (sorted by line).
+// A single model is kept by the plugin and shown by the tree of every main
+// window, so each mark change is handled once.
+//
+// Bookmarks are tracked with moving cursors rather than KTextEditor::Mark
+// pointers, which the document replaces whenever marks change; the line of a
+// row follows edits to the text until the next update.
+//
+// The bookmarks of closed files are listed too, from a BookmarkIndex saved
+// whenever they change. When such a file is opened, its bookmarks are put
+// back on the lines with the text they were set on, unless the document
+// brought bookmarks of its own.
+class BookmarksModel : public QAbstractItemModel
+{
+    Q_OBJECT
+public:
+    enum ItemDataRole {
+        DocumentRole = Qt::UserRole,
+        // The line of a bookmark, or -1 for a document.
+        LineRole,
+        UrlRole,
+    };
+
+    explicit BookmarksModel(const QString &indexPath, QObject *parent = nullptr);
+    ~BookmarksModel() override;
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+
+    // The open document of a row, or null for a closed file.
+    KTextEditor::Document *document(const QModelIndex &index) const;
+    int line(const QModelIndex &index) const;
+    QUrl url(const QModelIndex &index) const;
+    // What a filter matches a row by: the file name of a file, the trimmed
+    // line of a bookmark. Bookmark texts are cached, and read again from a
+    // document only after it was edited.
+    QString searchText(const QModelIndex &index) const;
+
+    // The bookmark after (before) line in the file at url, in the order of
+    // URL then line, wrapping around at either end; an invalid index when
+    // there are no bookmarks. Found by binary search, in O(log n).
+    QModelIndex nextBookmark(const QUrl &url, int line) const;
+    QModelIndex previousBookmark(const QUrl &url, int line) const;
+
+    // Reads the index and the marks of the open documents, in one pass, the
+    // first time the bookmarks are needed. Until then documents (as a session
+    // restores them) are only noted, and the index is left as it is.
+    void populate();
+    bool isPopulated() const;
+
+    // Mark changes between the two are only queued; the last endBulkUpdate()
+    // applies them all at once.
+    void beginBulkUpdate();
+    void endBulkUpdate();
+
+public Q_SLOTS:
+    void refreshAll();
+    void scheduleRefresh(KTextEditor::Document *document);
+    void clearAll();
+    void clearBookmarks(KTextEditor::Document *document);
+    // Removes the bookmarks at indexes, and all those of the documents at
+    // indexes.
+    void removeBookmarks(const QModelIndexList &indexes);
+    void toggleBookmarks(KTextEditor::Document *document, const QList<int> &lines);
+
+private:
+    struct BookmarkFile {
+        // The open document, or null for a file known from the index only.
+        KTextEditor::Document *document = nullptr;
+        // The URL the file is sorted by, as it was when last updated.
+        QUrl url;
+        std::vector<std::unique_ptr<KTextEditor::MovingCursor>> bookmarks;
+        // The bookmarks of a closed file.
+        QList<BookmarkIndex::Bookmark> stored;
+        // The search texts of the bookmarks, filled when first asked for.
+        mutable QStringList texts;
+        mutable bool textsStale = true;
+        // The row of the file, so that parent() needs no search.
+        int row = -1;
+    };
+
+    void connectDocument(KTextEditor::Document *document);
+    void removeDocument(KTextEditor::Document *document);
+    void closeDocument(KTextEditor::Document *document);
+    void flushPendingRefreshes();
+    void flushEditedDocuments();
+    void refreshBookmarks(KTextEditor::Document *document);
+    QList<int> restoreBookmarks(KTextEditor::Document *document, const QList<BookmarkIndex::Bookmark> &stored);
+    void setStoredBookmarks(int row, const QList<BookmarkIndex::Bookmark> &stored);
+    void removeFile(int row);
+    int fileRow(const KTextEditor::Document *document) const;
+    int fileRow(const BookmarkFile *file) const;
+    int closedFileRow(const QUrl &url) const;
+    int sortedFileRow(const QUrl &url) const;
+    // Updates the rows of the files from row on, after files were inserted or
+    // removed there.
+    void renumberFiles(int row);
+    // The first row of file whose line is above line (at least line).
+    static int upperBookmarkRow(const BookmarkFile &file, int line);
+    static int lowerBookmarkRow(const BookmarkFile &file, int line);
+    static int bookmarkCount(const BookmarkFile &file);
+    static int bookmarkLine(const BookmarkFile &file, int row);
+    void loadIndex();
+    void saveIndex();
+    static QList<int> bookmarkLines(KTextEditor::Document *document);
+    static void setBookmarks(BookmarkFile *file, const QList<int> &lines);
+
+    std::vector<std::unique_ptr<BookmarkFile>> m_files;
+    BookmarkIndex m_index;
+    // Saves the index a little after the bookmarks change.
+    QTimer m_saveTimer;
+    // Documents whose marks changed since the last update; a burst of mark
+    // changes is applied at once on the next event loop iteration.
+    QSet<KTextEditor::Document *> m_pendingDocuments;
+    // Documents edited since the search texts of their bookmarks were read.
+    mutable QSet<KTextEditor::Document *> m_editedDocuments;
+    // Documents edited since their bookmark rows were last reported changed;
+    // a burst of typing is reported once, a little later.
+    QSet<KTextEditor::Document *> m_changedDocuments;
+    QTimer m_changedTimer;
+    QTimer m_refreshTimer;
+    int m_bulkUpdates = 0;
+    bool m_populated = false;
+};
@@ -1,5 +1,8 @@
 #include "BookmarksTreePlugin.hpp"
+#include "BookmarksFilterModel.hpp"
+#include "BookmarksModel.hpp"
 
+#include <KActionCollection>
 #include <KPluginFactory>
 #include <KTextEditor/Application>
 #include <KTextEditor/Cursor>
@@ -7,16 +10,20 @@
 #include <KTextEditor/Editor>
 #include <KTextEditor/MainWindow>
 #include <KTextEditor/View>
+#include <KXMLGUIFactory>
 
 #include <QAction>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QEvent>
 #include <QHeaderView>
 #include <QIcon>
+#include <QLineEdit>
 #include <QMenu>
+#include <QStandardPaths>
 #include <QVBoxLayout>
 #include <QVariantMap>
 
-#include <algorithm>
-
 using namespace Qt::Literals::StringLiterals;
 
 K_PLUGIN_CLASS_WITH_JSON(BookmarksTreePlugin, "bookmarks_tree.json")
@@ -24,6 +31,10 @@ K_PLUGIN_CLASS_WITH_JSON(BookmarksTreePlugin, "bookmarks_tree.json")
 BookmarksTreePlugin::BookmarksTreePlugin(QObject *parent, const QList<QVariant> &)
     : KTextEditor::Plugin(parent)
 {
+    QElapsedTimer timer;
+    timer.start();
+    m_model = new BookmarksModel(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + u"/bookmarks_tree/index"_s, this);
+    qInfo() << "[bookmarks] Plugin loaded in" << timer.elapsed() << "ms";
 }
 
 QObject *BookmarksTreePlugin::createView(KTextEditor::MainWindow *mainWindow)
@@ -31,6 +42,11 @@ QObject *BookmarksTreePlugin::createView(KTextEditor::MainWindow *mainWindow)
     return new BookmarksTreeView(this, mainWindow);
 }
 
+BookmarksModel *BookmarksTreePlugin::model() const
+{
+    return m_model;
+}
+
 void BookmarksTreeView::showMessage(const QString &msg)
 {
     // clang-format off
@@ -49,123 +65,244 @@ BookmarksTreeView::BookmarksTreeView(BookmarksTreePlugin *plugin, KTextEditor::M
     , m_plugin(plugin)
     , m_mainWindow(mainWindow)
 {
-    setupUi();
-    connectSignals();
+    QElapsedTimer timer;
+    timer.start();
+    setupToolView();
+    setupActions();
+    qInfo() << "[bookmarks] View created in" << timer.elapsed() << "ms";
 }
 
-void BookmarksTreeView::setupUi()
+BookmarksTreeView::~BookmarksTreeView()
+{
+    m_mainWindow->guiFactory()->removeClient(this);
+}
+
+void BookmarksTreeView::setupActions()
+{
+    KXMLGUIClient::setComponentName(u"bookmarks_tree"_s, tr("Bookmarks Tree"));
+    setXMLFile(u"actions.rc"_s);
+
+    auto actionNext = actionCollection()->addAction(u"bookmarks_tree_next"_s);
+    actionNext->setIcon(QIcon::fromTheme(u"go-down-search"_s));
+    actionNext->setText(tr("Next Bookmark in All Documents"));
+    KActionCollection::setDefaultShortcut(actionNext, QKeySequence(Qt::CTRL | Qt::ALT | Qt::Key_PageDown));
+    connect(actionNext, &QAction::triggered, this, &BookmarksTreeView::goToNextBookmark);
+
+    auto actionPrevious = actionCollection()->addAction(u"bookmarks_tree_previous"_s);
+    actionPrevious->setIcon(QIcon::fromTheme(u"go-up-search"_s));
+    actionPrevious->setText(tr("Previous Bookmark in All Documents"));
+    KActionCollection::setDefaultShortcut(actionPrevious, QKeySequence(Qt::CTRL | Qt::ALT | Qt::Key_PageUp));
+    connect(actionPrevious, &QAction::triggered, this, &BookmarksTreeView::goToPreviousBookmark);
+
+    m_mainWindow->guiFactory()->addClient(this);
+}
+
+// Only the (empty) tool view is made with the main window; its contents, and
+// the bookmarks they show, wait until it is first shown (see ensureUi()).
+void BookmarksTreeView::setupToolView()
 {
     // clang-format off
     m_toolView = m_mainWindow->createToolView(m_plugin, u"BookmarksTreePlugin"_s,
                                               KTextEditor::MainWindow::Left, QIcon::fromTheme(u"bookmarks"_s), tr("Bookmarks"));
     // clang-format on
+    m_toolView->installEventFilter(this);
+}
+
+bool BookmarksTreeView::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == m_toolView && event->type() == QEvent::Show) {
+        ensureUi();
+    }
+    return QObject::eventFilter(watched, event);
+}
+
+void BookmarksTreeView::ensureUi()
+{
+    if (m_treeView) {
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    m_plugin->model()->populate();
+    setupUi();
+    connectSignals();
+    qInfo() << "[bookmarks] Tool view built in" << timer.elapsed() << "ms";
+}
+
+void BookmarksTreeView::setupUi()
+{
+    m_filterEdit = new QLineEdit(m_toolView);
+    m_filterEdit->setPlaceholderText(tr("Filter..."));
+    m_filterEdit->setClearButtonEnabled(true);
+    m_toolView->layout()->addWidget(m_filterEdit);
+
+    m_filterModel = new BookmarksFilterModel(m_plugin->model(), this);
 
-    m_treeWidget = new QTreeWidget(m_toolView);
-    m_treeWidget->setSizePolicy(QSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding));
-    m_treeWidget->setContextMenuPolicy(Qt::CustomContextMenu);
-    m_treeWidget->setHeaderLabel(tr("Bookmarks"));
-    m_treeWidget->header()->setDefaultAlignment(Qt::AlignCenter);
-    m_toolView->layout()->addWidget(m_treeWidget);
+    m_treeView = new QTreeView(m_toolView);
+    m_treeView->setSizePolicy(QSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding));
+    m_treeView->setContextMenuPolicy(Qt::CustomContextMenu);
+    m_treeView->setSelectionMode(QAbstractItemView::ExtendedSelection);
+    m_treeView->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    m_treeView->setModel(m_filterModel);
+    m_treeView->header()->setDefaultAlignment(Qt::AlignCenter);
+    m_treeView->expandAll();
+    m_toolView->layout()->addWidget(m_treeView);
 }
 
 void BookmarksTreeView::connectSignals()
 {
-    auto app = KTextEditor::Editor::instance()->application();
-    connect(app, &KTextEditor::Application::documentCreated, [this](KTextEditor::Document *document) {
-        connect(document, &KTextEditor::Document::markChanged, [this](auto, auto, auto) {
-            refreshAllBookmarks();
-        });
-        refreshAllBookmarks();
+    // Documents are shown expanded, as they come and when their bookmarks are
+    // replaced.
+    connect(m_filterModel, &QAbstractItemModel::rowsInserted, m_treeView, [this](const QModelIndex &parent, int first, int last) {
+        if (parent.isValid()) {
+            m_treeView->expand(parent);
+            return;
+        }
+        for (int row = first; row <= last; ++row) {
+            m_treeView->expand(m_filterModel->index(row, 0));
+        }
+    });
+    connect(m_filterModel, &QAbstractItemModel::modelReset, m_treeView, &QTreeView::expandAll);
+    connect(m_filterModel, &QAbstractItemModel::layoutChanged, m_treeView, &QTreeView::expandAll);
+    connect(m_filterEdit, &QLineEdit::textChanged, this, [this](const QString &text) {
+        m_filterModel->setPattern(text);
+        m_treeView->expandAll();
     });
 
-    connect(m_treeWidget, &QTreeWidget::customContextMenuRequested, [this](const QPoint &pos) {
-        auto menu = new QMenu(m_treeWidget);
+    connect(m_treeView, &QTreeView::customContextMenuRequested, [this](const QPoint &pos) {
+        auto menu = new QMenu(m_treeView);
         menu->setAttribute(Qt::WA_DeleteOnClose);
         auto actionRefresh = menu->addAction(QIcon::fromTheme("view-refresh"), tr("Refresh Bookmarks"));
+        auto actionToggle = menu->addAction(QIcon::fromTheme("bookmark-new"), tr("Toggle Bookmarks on Selected Lines"));
+        auto actionRemove = menu->addAction(QIcon::fromTheme("edit-delete"), tr("Remove Selected Bookmarks"));
         auto actionClear = menu->addAction(QIcon::fromTheme("bookmark-remove"), tr("Clear all Bookmarks"));
+        auto view = m_mainWindow->activeView();
+        actionToggle->setEnabled(view && view->selection());
+        actionRemove->setEnabled(m_treeView->selectionModel()->hasSelection());
         connect(actionRefresh, &QAction::triggered, this, &BookmarksTreeView::refreshAllBookmarks);
+        connect(actionToggle, &QAction::triggered, this, &BookmarksTreeView::toggleSelectedLines);
+        connect(actionRemove, &QAction::triggered, this, &BookmarksTreeView::removeSelectedBookmarks);
         connect(actionClear, &QAction::triggered, this, &BookmarksTreeView::clearAllBookmarks);
-        menu->popup(m_treeWidget->mapToGlobal(pos));
+        menu->popup(m_treeView->viewport()->mapToGlobal(pos));
     });
 
-    connect(m_treeWidget, &QTreeWidget::itemDoubleClicked, [this](QTreeWidgetItem *item, auto) {
-        auto document = item->data(0, DocumentRole).value<KTextEditor::Document *>();
-        auto mark = item->data(0, MarkRole).value<KTextEditor::Mark *>();
-        if (document && mark) {
-            jumpToBookmark(document, mark);
+    connect(m_treeView, &QTreeView::doubleClicked, [this](const QModelIndex &index) {
+        auto model = m_plugin->model();
+        auto line = model->line(index);
+        if (line >= 0) {
+            jumpToBookmark(model->url(index), line);
         }
     });
 }
 
 void BookmarksTreeView::clearAllBookmarks()
 {
-    m_treeWidget->clear();
-    auto documents = KTextEditor::Editor::instance()->documents();
-    for (auto document : documents) {
-        clearBookmarks(document);
-    }
+    m_plugin->model()->clearAll();
 }
 
 void BookmarksTreeView::clearBookmarks(KTextEditor::Document *document)
 {
-    auto marks = document->marks().values();
-    for (auto mark : marks) {
-        document->clearMark(mark->line);
-    }
+    m_plugin->model()->clearBookmarks(document);
 }
 
-void BookmarksTreeView::refreshAllBookmarks()
+// Removes the selected bookmarks, and all those of the selected files.
+void BookmarksTreeView::removeSelectedBookmarks()
 {
-    m_treeWidget->clear();
-    auto documents = KTextEditor::Editor::instance()->documents();
-    std::sort(documents.begin(), documents.end(), [](auto d1, auto d2) {
-        return d1->url() < d2->url();
-    });
-    for (auto document : documents) {
-        refreshBookmarks(document);
+    if (!m_treeView) {
+        return;
     }
+    QModelIndexList indexes;
+    const auto selected = m_treeView->selectionModel()->selectedRows();
+    for (const auto &index : selected) {
+        indexes.append(m_filterModel->mapToSource(index));
+    }
+    m_plugin->model()->removeBookmarks(indexes);
+}
+
+void BookmarksTreeView::toggleBookmarks(KTextEditor::Document *document, const QList<int> &lines)
+{
+    m_plugin->model()->toggleBookmarks(document, lines);
 }
 
-void BookmarksTreeView::refreshBookmarks(KTextEditor::Document *document)
+// Toggles a bookmark on every line of the selection in the active view.
+void BookmarksTreeView::toggleSelectedLines()
 {
-    if (!document || !document->url().isValid()) {
+    auto view = m_mainWindow->activeView();
+    if (!view || !view->selection()) {
         return;
     }
-    auto fileItem = new QTreeWidgetItem({document->url().fileName()});
-    fileItem->setIcon(0, QIcon::fromTheme("document-multiple"));
-    auto marks = document->marks().values();
-    std::sort(marks.begin(), marks.end(), [](auto m1, auto m2) {
-        return m1->line < m2->line;
-    });
-    for (auto mark : marks) {
-        if (!(mark->type & KTextEditor::Document::Bookmark)) {
-            continue;
-        }
-        auto lineContent = document->line(mark->line).trimmed();
-        auto itemContent = QString("%1: %2").arg(mark->line + 1).arg(lineContent);
-        auto item = new QTreeWidgetItem({itemContent});
-        item->setIcon(0, QIcon::fromTheme("bookmarks"));
-        item->setData(0, DocumentRole, QVariant::fromValue(document));
-        item->setData(0, MarkRole, QVariant::fromValue(mark));
-        fileItem->addChild(item);
+    const auto range = view->selectionRange();
+    // A selection ending at the start of a line does not take that line in.
+    int lastLine = range.end().line();
+    if (range.end().column() == 0 && lastLine > range.start().line()) {
+        --lastLine;
     }
+    QList<int> lines;
+    for (int line = range.start().line(); line <= lastLine; ++line) {
+        lines.append(line);
+    }
+    toggleBookmarks(view->document(), lines);
+}
 
-    if (fileItem->childCount() == 0) {
-        delete fileItem;
+void BookmarksTreeView::refreshAllBookmarks()
+{
+    m_plugin->model()->refreshAll();
+}
+
+// Opens the file if it is not open yet, and puts the cursor at the start of
+// the line's text.
+void BookmarksTreeView::jumpToBookmark(const QUrl &url, int line)
+{
+    if (!url.isValid() || line < 0) {
         return;
     }
-    m_treeWidget->addTopLevelItem(fileItem);
-    fileItem->setExpanded(true);
+    if (auto view = m_mainWindow->openUrl(url)) {
+        const auto text = view->document()->line(line);
+        int column = 0;
+        while (column < text.size() && text.at(column).isSpace()) {
+            ++column;
+        }
+        view->setCursorPosition(KTextEditor::Cursor(line, column));
+    }
 }
 
-void BookmarksTreeView::jumpToBookmark(KTextEditor::Document *document, KTextEditor::Mark *mark)
+// Goes from the cursor of the active view, or from before the first bookmark
+// if there is none.
+void BookmarksTreeView::goToNextBookmark()
 {
-    if (!document || !mark) {
+    auto view = m_mainWindow->activeView();
+    const auto url = view ? view->document()->url() : QUrl();
+    const int line = view ? view->cursorPosition().line() : -1;
+    m_plugin->model()->populate();
+    goToBookmark(m_plugin->model()->nextBookmark(url, line));
+}
+
+void BookmarksTreeView::goToPreviousBookmark()
+{
+    auto view = m_mainWindow->activeView();
+    const auto url = view ? view->document()->url() : QUrl();
+    const int line = view ? view->cursorPosition().line() : -1;
+    m_plugin->model()->populate();
+    goToBookmark(m_plugin->model()->previousBookmark(url, line));
+}
+
+void BookmarksTreeView::goToBookmark(const QModelIndex &index)
+{
+    if (!index.isValid()) {
+        showMessage(tr("There are no bookmarks."));
+        return;
+    }
+    auto model = m_plugin->model();
+    jumpToBookmark(model->url(index), model->line(index));
+    // The tree follows, unless the filter hides the bookmark.
+    if (!m_filterModel) {
         return;
     }
-    if (auto view = m_mainWindow->openUrl(document->url())) {
-        view->setCursorPosition(KTextEditor::Cursor(mark->line, 0));
+    const auto filtered = m_filterModel->mapFromSource(index);
+    if (filtered.isValid()) {
+        m_treeView->setCurrentIndex(filtered);
+        m_treeView->scrollTo(filtered);
     }
 }
 
-#include "BookmarksTreePlugin.moc"
+#include "BookmarksTreePlugin.moc"
\ No newline at end of file
@@ -1,11 +1,16 @@
 #pragma once
 
-#include <QTreeWidget>
 #include <QObject>
+#include <QTreeView>
 
 #include <KTextEditor/Document>
 #include <KTextEditor/Plugin>
 #include <KTextEditor/View>
+#include <KXMLGUIClient>
+
+class BookmarksFilterModel;
+class BookmarksModel;
+class QLineEdit;
 
 class BookmarksTreePlugin : public KTextEditor::Plugin
 {
@@ -13,32 +18,51 @@ class BookmarksTreePlugin : public KTextEditor::Plugin
 public:
     explicit BookmarksTreePlugin(QObject *parent = nullptr, const QList<QVariant> & = QList<QVariant>());
     QObject *createView(KTextEditor::MainWindow *mainWindow) override;
+
+    // The bookmarks shown by the views of all main windows, including those of
+    // closed files, which are kept in an index in the application's data
+    // directory.
+    BookmarksModel *model() const;
+
+private:
+    BookmarksModel *m_model = nullptr;
 };
 
-class BookmarksTreeView : public QObject
+class BookmarksTreeView : public QObject, public KXMLGUIClient
 {
     Q_OBJECT
 public:
     explicit BookmarksTreeView(BookmarksTreePlugin *plugin, KTextEditor::MainWindow *mainWindow);
-    
+    ~BookmarksTreeView() override;
+
 public Q_SLOTS:
     void clearAllBookmarks();
     void clearBookmarks(KTextEditor::Document *document);
+    void removeSelectedBookmarks();
+    void toggleBookmarks(KTextEditor::Document *document, const QList<int> &lines);
+    void toggleSelectedLines();
     void refreshAllBookmarks();
-    void refreshBookmarks(KTextEditor::Document *document);
-    void jumpToBookmark(KTextEditor::Document *document, KTextEditor::Mark *mark);
+    void jumpToBookmark(const QUrl &url, int line);
+    // Go to the bookmark after (before) the cursor, in any document.
+    void goToNextBookmark();
+    void goToPreviousBookmark();
+
+protected:
+    bool eventFilter(QObject *watched, QEvent *event) override;
 
 private:
-    enum ItemDataRole {
-        DocumentRole = Qt::UserRole,
-        MarkRole = Qt::UserRole + 1,
-    };
     void showMessage(const QString &msg);
+    void setupToolView();
+    void ensureUi();
     void setupUi();
+    void setupActions();
     void connectSignals();
+    void goToBookmark(const QModelIndex &index);
 
     BookmarksTreePlugin *m_plugin = nullptr;
     KTextEditor::MainWindow *m_mainWindow = nullptr;
     QWidget *m_toolView = nullptr;
-    QTreeWidget *m_treeWidget = nullptr;
-};
\ No newline at end of file
+    QLineEdit *m_filterEdit = nullptr;
+    BookmarksFilterModel *m_filterModel = nullptr;
+    QTreeView *m_treeView = nullptr;
+};
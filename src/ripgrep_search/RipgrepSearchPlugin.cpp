@@ -1,23 +1,32 @@
 #include "RipgrepSearchPlugin.hpp"
 #include "RipgrepSearchView.hpp"
+#include "SearchEngine.hpp"
 
 #include <KActionCollection>
 #include <KConfigGroup>
 #include <KPluginFactory>
 #include <KXMLGUIFactory>
 
+#include <QDebug>
+#include <QElapsedTimer>
+
 K_PLUGIN_CLASS_WITH_JSON(RipgrepSearchPlugin, "kate_ripgrep_search.json")
 
 struct RipgrepSearchPluginPrivate {
     RipgrepSearchPlugin *q;
     QList<RipgrepSearchView *> views;
+    SearchEngine *engine = nullptr;
 };
 
 RipgrepSearchPlugin::RipgrepSearchPlugin(QObject *parent)
     : KTextEditor::Plugin(parent)
     , d(new RipgrepSearchPluginPrivate)
 {
+    QElapsedTimer timer;
+    timer.start();
     d->q = this;
+    d->engine = new SearchEngine(this);
+    qInfo() << "[ripgrep] Plugin loaded in" << timer.elapsed() << "ms";
 }
 
 RipgrepSearchPlugin::~RipgrepSearchPlugin()
@@ -37,4 +46,9 @@ QObject *RipgrepSearchPlugin::createView(KTextEditor::MainWindow *mainWindow)
     return view;
 }
 
+SearchEngine *RipgrepSearchPlugin::engine() const
+{
+    return d->engine;
+}
+
 #include "RipgrepSearchPlugin.moc"
@@ -6,6 +6,7 @@ namespace KTextEditor
 class MainWindow;
 }
 class RipgrepSearchPluginPrivate;
+class SearchEngine;
 
 class RipgrepSearchPlugin : public KTextEditor::Plugin
 {
@@ -15,6 +16,9 @@ public:
     ~RipgrepSearchPlugin() override;
     QObject *createView(KTextEditor::MainWindow *mainWindow) override;
 
+    // Runs the searches of all windows, see SearchEngine.
+    SearchEngine *engine() const;
+
 private:
     const QScopedPointer<RipgrepSearchPluginPrivate> d;
 };
@@ -1,8 +1,14 @@
 #include "RipgrepSearchView.hpp"
+#include "FileListCache.hpp"
+#include "GlobFilter.hpp"
+#include "LineIndex.hpp"
+#include "ResultExporter.hpp"
 #include "RipgrepCommand.hpp"
 #include "RipgrepSearchPlugin.hpp"
+#include "SearchEngine.hpp"
 #include "SearchResultsModel.hpp"
 #include "SearchResultsView.hpp"
+#include "SearchTimeline.hpp"
 
 #include <KActionCollection>
 #include <KTextEditor/Document>
@@ -16,29 +22,40 @@
 #include <QApplication>
 #include <QByteArray>
 #include <QComboBox>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QEvent>
 #include <QFile>
+#include <QFileDialog>
 #include <QFileInfo>
-#include <QFileSystemWatcher>
 #include <QFormLayout>
 #include <QHash>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QLabel>
 #include <QLineEdit>
+#include <QListWidget>
 #include <QMap>
+#include <QMenu>
+#include <QPointer>
 #include <QProcess>
 #include <QPushButton>
+#include <QSet>
 #include <QSizePolicy>
+#include <QSpinBox>
 #include <QStackedWidget>
 #include <QStandardPaths>
 #include <QStatusBar>
 #include <QStyle>
 #include <QStyledItemDelegate>
+#include <QTabBar>
 #include <QTextStream>
 #include <QTimer>
 #include <QToolBar>
+#include <QToolButton>
 #include <QVBoxLayout>
 #include <QVariantMap>
+#include <QWidgetAction>
 
 #include <algorithm>
 
@@ -47,23 +64,43 @@ class RipgrepSearchViewPrivate : public QObject
     Q_OBJECT
 public slots:
     void setupActions();
+    void setupToolView();
     void setupUi();
-    void setupRipgrepProcess();
     void startSearch();
+    void refresh();
+    void setFileNameMode(bool enabled);
+    void searchFileNames();
     void searchSelection();
     void resetStatusMessage();
     void clearResults();
     void replaceAll();
     void updateReplaceState();
-    void scheduleResearch();
-    void watchResultFile(const QString &file);
+    void showTab(int index);
+    void closeTab(int index);
+    void setTabPinned(bool pinned);
+    void showTimeline();
+    void exportTimeline();
+    void exportResults();
+    void exportSearch();
 
 public:
-    void clearWatches();
-
+    bool ensureUi();
+    void attach(SearchSession *next, const QString &term);
+    void showResults(SearchSession *next);
+    void addTab();
+    void updateTabText(int index);
+    void showSessionState();
+    ResultExporter *createExporter(const QString &caption);
+    void updateWatchUsage();
+
+    QString searchQuery(const QString &term, const QStringList &baseDirs) const;
+    SearchRequest searchRequest(const QString &term, const QStringList &baseDirs);
     QString projectBaseDir();
+    QStringList searchDirs();
+    QStringList projectFiles();
     QStringList openedFiles();
-    const QList<qint64> &lineStartsFor(const QString &file);
+    QList<SearchBuffer> unsavedBuffers(const QStringList &baseDirs, QHash<QString, QPointer<KTextEditor::Document>> *documents);
+    KTextEditor::View *openResultFile(const QString &file);
     KTextEditor::Range mapToKate(const QString &file, qint64 byteStart, qint64 byteEnd, KTextEditor::Document *doc);
     KTextEditor::Document *documentForFile(const QString &file, bool *wasOpen);
     QAction *addAction(const QString &name, const QString &iconName, const QString &text);
@@ -71,34 +108,70 @@ public:
     QComboBox *createEditableComboBox(const QString &placeholderText);
     QWidget *createPlaceholder();
     bool ripgrepAvailable();
+    bool eventFilter(QObject *watched, QEvent *event) override;
 
     RipgrepSearchView *q;
     RipgrepSearchPlugin *plugin = nullptr;
     bool rgAvailable = true;
+    // Whether setupUi() has run; see ensureUi().
+    bool uiBuilt = false;
     KTextEditor::MainWindow *mainWindow = nullptr;
     QWidget *toolView = nullptr;
     QComboBox *searchBox = nullptr;
     QAction *searchSelectionAction = nullptr;
     QAction *refreshAction = nullptr;
     QAction *clearAction = nullptr;
+    QAction *exportResultsAction = nullptr;
+    QAction *exportSearchAction = nullptr;
+    QAction *pinAction = nullptr;
     QAction *wholeWordAction = nullptr;
     QAction *caseSensitiveAction = nullptr;
     QAction *useRegexAction = nullptr;
+    QAction *multilineAction = nullptr;
+    QAction *searchUnsavedAction = nullptr;
+    QAction *fileNamesAction = nullptr;
+    QAction *projectFileListAction = nullptr;
+    QAction *allProjectsAction = nullptr;
     QAction *showReplaceAction = nullptr;
     QAction *showAdvancedAction = nullptr;
     QComboBox *replaceBox = nullptr;
     QPushButton *replaceAllButton = nullptr;
     QComboBox *includeFileBox = nullptr;
     QComboBox *excludeFileBox = nullptr;
+    QSpinBox *contextBeforeBox = nullptr;
+    QSpinBox *contextAfterBox = nullptr;
+    // Holding a spin box's arrow steps it many times; only where it stops is
+    // searched.
+    QTimer *contextTimer = nullptr;
+    // The results shown: those of the session, or emptyModel without one.
     SearchResultsModel *resultsModel = nullptr;
+    SearchResultsModel *emptyModel = nullptr;
     SearchResultsView *resultsView = nullptr;
+    // In file name mode the files matching the term are shown instead of the
+    // results, from the file list of the project kept by the engine.
+    QStackedWidget *resultsStack = nullptr;
+    QListWidget *fileNameList = nullptr;
+    QPointer<FileListCache> fileList;
     QStatusBar *statusBar = nullptr;
-    RipgrepCommand *rg = nullptr;
-    QFileSystemWatcher *fileWatcher = nullptr;
-    QTimer *researchTimer = nullptr;
-    // Per-file cache of the byte offsets at which each Kate line begins, built
-    // lazily on first navigation into a file and dropped when a new search runs.
-    QHash<QString, QList<qint64>> lineStartCache;
+    QToolButton *timelineButton = nullptr;
+    QPointer<SearchEngine> engine;
+    // One search per result tab, each shared with every other window (or tab)
+    // showing the same search. A new search replaces the search of the current
+    // tab, unless that is pinned, in which case it gets a tab of its own.
+    struct ResultTab {
+        QPointer<SearchSession> session;
+        QString term;
+        bool pinned = false;
+    };
+    QTabBar *tabBar = nullptr;
+    QList<ResultTab> tabs;
+    // The search of the current tab, whose results are shown. Re-running it
+    // merges into its results instead of starting from scratch.
+    QPointer<SearchSession> session;
+    // Runs export-only searches, whose results go straight to exportRun
+    // instead of any session.
+    RipgrepCommand *exportCommand = nullptr;
+    QPointer<ResultExporter> exportRun;
 };
 
 RipgrepSearchView::RipgrepSearchView(RipgrepSearchPlugin *plugin, KTextEditor::MainWindow *mainWindow)
@@ -109,15 +182,22 @@ RipgrepSearchView::RipgrepSearchView(RipgrepSearchPlugin *plugin, KTextEditor::M
     d->q = this;
     d->plugin = plugin;
     d->mainWindow = mainWindow;
-    d->rg = new RipgrepCommand(this);
+    d->engine = plugin->engine();
 
+    QElapsedTimer timer;
+    timer.start();
     d->setupActions();
-    d->setupUi();
-    d->setupRipgrepProcess();
+    d->setupToolView();
+    qInfo() << "[ripgrep] View created in" << timer.elapsed() << "ms";
 }
 
 RipgrepSearchView::~RipgrepSearchView()
 {
+    // The tool view's widgets may be gone by now; only the sessions are let go.
+    for (const auto &tab : std::as_const(d->tabs)) {
+        if (tab.session && d->engine)
+            d->engine->release(tab.session);
+    }
     d->mainWindow->guiFactory()->removeClient(this);
 }
 
@@ -175,32 +255,48 @@ void RipgrepSearchViewPrivate::setupActions()
     connect(searchSelectionAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::searchSelection);
 
     refreshAction = addAction("ripgrep_refresh", "view-refresh", tr("Refresh"));
-    connect(refreshAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::startSearch);
+    connect(refreshAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::refresh);
 
     clearAction = addAction("ripgrep_clear", "edit-clear-all", tr("Clear results"));
     connect(clearAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::clearResults);
 
+    exportResultsAction = addAction("ripgrep_export_results", "document-export", tr("Export results..."));
+    connect(exportResultsAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::exportResults);
+
+    exportSearchAction = addAction("ripgrep_export_search", "document-save-as", tr("Search and export results..."));
+    connect(exportSearchAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::exportSearch);
+
+    pinAction = addCheckableAction("ripgrep_pin_results", "window-pin", tr("Pin results"));
+    connect(pinAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::setTabPinned);
+
     wholeWordAction = addCheckableAction("ripgrep_whole_word", "ime-punctuation-fullwidth", tr("Match whole words"));
-    connect(wholeWordAction, &QAction::triggered, rg, &RipgrepCommand::setWholeWord);
+    connect(wholeWordAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::startSearch);
 
     caseSensitiveAction = addCheckableAction("ripgrep_case_sensitive", "format-text-superscript", tr("Case sensitive"));
-    connect(caseSensitiveAction, &QAction::triggered, rg, &RipgrepCommand::setCaseSensitive);
+    connect(caseSensitiveAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::startSearch);
 
     useRegexAction = addCheckableAction("ripgrep_use_regex", "code-context", tr("Use regular expression"));
-    connect(useRegexAction, &QAction::triggered, rg, &RipgrepCommand::setUseRegex);
+    connect(useRegexAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::startSearch);
+
+    multilineAction = addCheckableAction("ripgrep_multiline", "format-line-spacing-double", tr("Match across lines"));
+    connect(multilineAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::startSearch);
+
+    searchUnsavedAction = addCheckableAction("ripgrep_search_unsaved", "document-edit", tr("Search unsaved changes"));
+    connect(searchUnsavedAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::startSearch);
+
+    fileNamesAction = addCheckableAction("ripgrep_file_names", "document-open", tr("Search file names"));
+    connect(fileNamesAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::setFileNameMode);
+
+    projectFileListAction = addCheckableAction("ripgrep_project_file_list", "view-list-details", tr("Search the files the project lists"));
+    connect(projectFileListAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::startSearch);
+
+    allProjectsAction = addCheckableAction("ripgrep_all_projects", "project-development", tr("Search all open projects"));
+    connect(allProjectsAction, &QAction::triggered, this, &RipgrepSearchViewPrivate::startSearch);
 
     showReplaceAction = addCheckableAction("ripgrep_show_replace", "edit-find-replace", tr("Show replace options"));
 
     showAdvancedAction = addCheckableAction("ripgrep_show_advanced", "overflow-menu", tr("Show advanced options"));
 
-    // Without rg there is nothing the actions (and their shortcuts) can do, so
-    // disable them all; the tool view shows a placeholder explaining why.
-    rgAvailable = ripgrepAvailable();
-    if (!rgAvailable) {
-        for (auto action : q->actionCollection()->actions())
-            action->setEnabled(false);
-    }
-
     mainWindow->guiFactory()->addClient(q);
 }
 
@@ -214,14 +310,49 @@ QComboBox *RipgrepSearchViewPrivate::createEditableComboBox(const QString &place
     return comboBox;
 }
 
-void RipgrepSearchViewPrivate::setupUi()
+// Only the (empty) tool view is made with the main window, so that loading
+// the plugin costs next to nothing; looking for rg and building the search UI
+// wait until the tool view is first shown, or an action needs them.
+void RipgrepSearchViewPrivate::setupToolView()
 {
     // clang-format off
     toolView = mainWindow->createToolView(plugin, "RipgrepSearchPlugin",
                                               KTextEditor::MainWindow::Left,
                                               QIcon::fromTheme("search"), tr("Ripgrep Search"));
     // clang-format on
+    toolView->installEventFilter(this);
+}
+
+bool RipgrepSearchViewPrivate::eventFilter(QObject *watched, QEvent *event)
+{
+    if (watched == toolView && event->type() == QEvent::Show)
+        ensureUi();
+    return QObject::eventFilter(watched, event);
+}
 
+// Builds the search UI if it is not yet; returns whether searching is possible.
+bool RipgrepSearchViewPrivate::ensureUi()
+{
+    if (uiBuilt)
+        return rgAvailable;
+    uiBuilt = true;
+
+    QElapsedTimer timer;
+    timer.start();
+    // Without rg there is nothing the actions (and their shortcuts) can do, so
+    // disable them all; the tool view shows a placeholder explaining why.
+    rgAvailable = ripgrepAvailable();
+    if (!rgAvailable) {
+        for (auto action : q->actionCollection()->actions())
+            action->setEnabled(false);
+    }
+    setupUi();
+    qInfo() << "[ripgrep] Tool view built in" << timer.elapsed() << "ms";
+    return rgAvailable;
+}
+
+void RipgrepSearchViewPrivate::setupUi()
+{
     // The search UI and the "rg not found" notice live on two pages of a stack;
     // only one is ever shown depending on whether ripgrep is on PATH.
     auto contentStack = new QStackedWidget(toolView);
@@ -236,6 +367,7 @@ void RipgrepSearchViewPrivate::setupUi()
     headerBar->addWidget(searchLabel);
     headerBar->addAction(refreshAction);
     headerBar->addAction(clearAction);
+    headerBar->addAction(pinAction);
     headerBar->addAction(showReplaceAction);
     headerBar->addAction(showAdvancedAction);
     pageLayout->addWidget(headerBar);
@@ -246,10 +378,20 @@ void RipgrepSearchViewPrivate::setupUi()
     searchBar->addAction(wholeWordAction);
     searchBar->addAction(caseSensitiveAction);
     searchBar->addAction(useRegexAction);
+    searchBar->addAction(multilineAction);
+    searchBar->addAction(searchUnsavedAction);
+    searchBar->addAction(fileNamesAction);
+    searchBar->addAction(projectFileListAction);
+    searchBar->addAction(allProjectsAction);
     pageLayout->addWidget(searchBar);
+    // File names are matched as they are typed; contents only on return.
+    connect(searchBox->lineEdit(), &QLineEdit::textEdited, this, [this] {
+        if (fileNamesAction->isChecked())
+            searchFileNames();
+    });
 
     auto replaceBar = createToolBar(searchPage);
-    replaceBar->setVisible(false);
+    replaceBar->setVisible(showReplaceAction->isChecked());
     pageLayout->addWidget(replaceBar);
     connect(showReplaceAction, &QAction::triggered, replaceBar, &QToolBar::setVisible);
     replaceBox = createEditableComboBox(tr("Replace with"));
@@ -260,7 +402,7 @@ void RipgrepSearchViewPrivate::setupUi()
     replaceBar->addWidget(replaceAllButton);
 
     auto includeBar = createToolBar(searchPage);
-    includeBar->setVisible(false);
+    includeBar->setVisible(showAdvancedAction->isChecked());
     pageLayout->addWidget(includeBar);
     connect(showAdvancedAction, &QAction::triggered, includeBar, &QToolBar::setVisible);
     auto filterContainer = new QWidget();
@@ -271,40 +413,86 @@ void RipgrepSearchViewPrivate::setupUi()
     excludeFileBox = createEditableComboBox(tr("Files to exclude, separated by commas"));
     filterForm->addRow(tr("Include:"), includeFileBox);
     filterForm->addRow(tr("Exclude:"), excludeFileBox);
-
-    resultsModel = new SearchResultsModel(this);
-    connect(resultsModel, &QAbstractItemModel::rowsInserted, this, &RipgrepSearchViewPrivate::updateReplaceState);
-    connect(resultsModel, &QAbstractItemModel::rowsRemoved, this, &RipgrepSearchViewPrivate::updateReplaceState);
-    connect(resultsModel, &QAbstractItemModel::modelReset, this, &RipgrepSearchViewPrivate::updateReplaceState);
+    contextBeforeBox = new QSpinBox();
+    contextAfterBox = new QSpinBox();
+    contextTimer = new QTimer(this);
+    contextTimer->setSingleShot(true);
+    contextTimer->setInterval(300);
+    connect(contextTimer, &QTimer::timeout, this, &RipgrepSearchViewPrivate::startSearch);
+    for (auto box : {contextBeforeBox, contextAfterBox}) {
+        box->setRange(0, 20);
+        box->setSuffix(tr(" lines"));
+        connect(box, &QSpinBox::valueChanged, contextTimer, qOverload<>(&QTimer::start));
+    }
+    filterForm->addRow(tr("Context before:"), contextBeforeBox);
+    filterForm->addRow(tr("Context after:"), contextAfterBox);
+
+    tabBar = new QTabBar(searchPage);
+    tabBar->setDocumentMode(true);
+    tabBar->setExpanding(false);
+    tabBar->setTabsClosable(true);
+    tabBar->setAutoHide(true);
+    tabBar->setElideMode(Qt::ElideRight);
+    pageLayout->addWidget(tabBar);
+    tabs.append({});
+    tabBar->addTab(QString());
+    updateTabText(0);
+    connect(tabBar, &QTabBar::currentChanged, this, &RipgrepSearchViewPrivate::showTab);
+    connect(tabBar, &QTabBar::tabCloseRequested, this, &RipgrepSearchViewPrivate::closeTab);
+
+    emptyModel = new SearchResultsModel(this);
+    resultsModel = emptyModel;
+    resultsStack = new QStackedWidget(searchPage);
+    pageLayout->addWidget(resultsStack);
     resultsView = new SearchResultsView(resultsModel, searchPage);
-    pageLayout->addWidget(resultsView);
+    resultsStack->addWidget(resultsView);
     resultsView->setHeaderHidden(true);
     resultsView->setSizePolicy(QSizePolicy(QSizePolicy::Expanding, QSizePolicy::Expanding));
     resultsView->setShowCheckboxes(showReplaceAction->isChecked());
     connect(showReplaceAction, &QAction::toggled, resultsView, &SearchResultsView::setShowCheckboxes);
     connect(resultsView, &SearchResultsView::jumpToFile, [this](const QString &file) {
-        mainWindow->openUrl(QUrl::fromLocalFile(file));
+        openResultFile(file);
     });
     connect(resultsView, &SearchResultsView::jumpToResult, [this](const QString &file, qint64 byteStart, qint64 byteEnd) {
-        if (auto view = mainWindow->openUrl(QUrl::fromLocalFile(file))) {
+        if (auto view = openResultFile(file)) {
             auto range = mapToKate(file, byteStart, byteEnd, view->document());
             view->setCursorPosition(range.start());
             view->setSelection(range);
         }
     });
 
+    fileNameList = new QListWidget(searchPage);
+    fileNameList->setUniformItemSizes(true);
+    resultsStack->addWidget(fileNameList);
+    connect(fileNameList, &QListWidget::itemActivated, this, [this](QListWidgetItem *item) {
+        mainWindow->openUrl(QUrl::fromLocalFile(item->data(Qt::UserRole).toString()));
+    });
+
     statusBar = new QStatusBar(searchPage);
     pageLayout->addWidget(statusBar);
     resetStatusMessage();
 
+    // Every search records where its time went; the model and view add what
+    // they spend on its results (see attach()).
+    timelineButton = new QToolButton(statusBar);
+    timelineButton->setIcon(QIcon::fromTheme("view-statistics"));
+    timelineButton->setAutoRaise(true);
+    timelineButton->setToolTip(tr("Search timings"));
+    timelineButton->setEnabled(false);
+    statusBar->addPermanentWidget(timelineButton);
+    connect(timelineButton, &QToolButton::clicked, this, &RipgrepSearchViewPrivate::showTimeline);
+
     contentStack->addWidget(searchPage);
     contentStack->addWidget(createPlaceholder());
     contentStack->setCurrentIndex(rgAvailable ? 0 : 1);
+
+    if (fileNamesAction->isChecked())
+        setFileNameMode(true);
 }
 
 bool RipgrepSearchViewPrivate::ripgrepAvailable()
 {
-    return !QStandardPaths::findExecutable(QStringLiteral("rg")).isEmpty();
+    return !QStandardPaths::findExecutable(RipgrepCommand::defaultProgram()).isEmpty();
 }
 
 QWidget *RipgrepSearchViewPrivate::createPlaceholder()
@@ -319,8 +507,8 @@ QWidget *RipgrepSearchViewPrivate::createPlaceholder()
 
     // clang-format off
     auto textLabel = new QLabel(tr("<b>ripgrep is not available</b><br/><br/>"
-                                   "The <tt>rg</tt> command could not be found on your PATH.<br/>"
-                                   "Please install ripgrep to use this plugin."));
+                                   "The <tt>%1</tt> command could not be found on your PATH.<br/>"
+                                   "Please install ripgrep to use this plugin.").arg(RipgrepCommand::defaultProgram().toHtmlEscaped()));
     // clang-format on
     textLabel->setAlignment(Qt::AlignCenter);
     textLabel->setWordWrap(true);
@@ -331,49 +519,261 @@ QWidget *RipgrepSearchViewPrivate::createPlaceholder()
     return placeholder;
 }
 
-void RipgrepSearchViewPrivate::setupRipgrepProcess()
+// Makes next the search of the current tab, letting go of the one it had.
+void RipgrepSearchViewPrivate::attach(SearchSession *next, const QString &term)
 {
-    connect(rg, &RipgrepCommand::searchOptionsChanged, this, &RipgrepSearchViewPrivate::startSearch);
-    connect(rg, &RipgrepCommand::matchFoundInFile, resultsModel, &SearchResultsModel::addMatchedFile);
-    connect(rg, &RipgrepCommand::matchFoundInFile, this, &RipgrepSearchViewPrivate::watchResultFile);
-    connect(rg, &RipgrepCommand::matchFound, resultsModel, &SearchResultsModel::addMatched);
-    connect(rg, &RipgrepCommand::searchFinished, [this](int found, qint64 nanos) {
-        auto seconds = QString::number(nanos / 1000000000.0, 'f', 6);
-        auto results = found == 1 ? tr("result") : tr("results");
-        statusBar->showMessage(tr("Found %1 %2 in %3 seconds.").arg(found).arg(results).arg(seconds));
-    });
+    const int index = tabBar->currentIndex();
+    auto &tab = tabs[index];
+    auto previous = tab.session;
+    tab.session = next;
+    tab.term = term;
+    updateTabText(index);
+    showResults(next);
+    if (previous && engine)
+        engine->release(previous);
+}
+
+void RipgrepSearchViewPrivate::showResults(SearchSession *next)
+{
+    if (session) {
+        disconnect(session, nullptr, this, nullptr);
+        disconnect(session->model(), nullptr, this, nullptr);
+    }
+    session = next;
+
+    resultsModel = session ? session->model() : emptyModel;
+    resultsView->setModel(resultsModel);
+    resultsView->setTimeline(session ? session->timeline() : nullptr);
+    updateReplaceState();
+    showSessionState();
+    if (!session)
+        return;
+
+    connect(resultsModel, &QAbstractItemModel::rowsInserted, this, &RipgrepSearchViewPrivate::updateReplaceState);
+    connect(resultsModel, &QAbstractItemModel::rowsRemoved, this, &RipgrepSearchViewPrivate::updateReplaceState);
+    connect(resultsModel, &QAbstractItemModel::modelReset, this, &RipgrepSearchViewPrivate::updateReplaceState);
+    connect(session, &SearchSession::started, this, &RipgrepSearchViewPrivate::showSessionState);
+    connect(session, &SearchSession::finished, this, &RipgrepSearchViewPrivate::showSessionState);
+    connect(session, &SearchSession::failed, this, &RipgrepSearchViewPrivate::showSessionState);
+}
+
+void RipgrepSearchViewPrivate::addTab()
+{
+    tabs.append({});
+    const int index = tabBar->addTab(QString());
+    updateTabText(index);
+    tabBar->setCurrentIndex(index);
+}
+
+void RipgrepSearchViewPrivate::updateTabText(int index)
+{
+    const auto &tab = tabs.at(index);
+    tabBar->setTabText(index, tab.term.isEmpty() ? tr("Search") : tab.term);
+    tabBar->setTabToolTip(index, tab.term);
+    tabBar->setTabIcon(index, tab.pinned ? QIcon::fromTheme("window-pin") : QIcon());
+}
+
+void RipgrepSearchViewPrivate::showTab(int index)
+{
+    if (index < 0 || index >= tabs.size())
+        return;
+    const auto &tab = tabs.at(index);
+    pinAction->setChecked(tab.pinned);
+    if (!tab.term.isEmpty())
+        searchBox->setEditText(tab.term);
+    if (tab.session != session)
+        showResults(tab.session);
+}
+
+void RipgrepSearchViewPrivate::closeTab(int index)
+{
+    // The last tab stays, just emptied.
+    if (tabs.size() == 1) {
+        tabs[0].pinned = false;
+        pinAction->setChecked(false);
+        attach(nullptr, QString());
+        return;
+    }
+    // The list is updated first: removing the tab makes another one current.
+    const auto tab = tabs.takeAt(index);
+    tabBar->removeTab(index);
+    if (tab.session && engine)
+        engine->release(tab.session);
+}
 
-    // ripgrep only ever sees what is on disk, so the results drift out of sync
-    // the moment a matched file changes — whether Kate saves an edited document
-    // or some external tool rewrites it. Watch every file that produced a result
-    // and re-run the search when it changes on disk.
-    fileWatcher = new QFileSystemWatcher(this);
-    connect(fileWatcher, &QFileSystemWatcher::fileChanged, this, &RipgrepSearchViewPrivate::scheduleResearch);
+void RipgrepSearchViewPrivate::setTabPinned(bool pinned)
+{
+    if (!ensureUi())
+        return;
+    const int index = tabBar->currentIndex();
+    tabs[index].pinned = pinned;
+    updateTabText(index);
+}
 
-    // Coalesce bursts of notifications (atomic saves delete-and-recreate the
-    // file, firing several changes) into a single re-search.
-    researchTimer = new QTimer(this);
-    researchTimer->setSingleShot(true);
-    researchTimer->setInterval(300);
-    connect(researchTimer, &QTimer::timeout, this, &RipgrepSearchViewPrivate::startSearch);
+void RipgrepSearchViewPrivate::showSessionState()
+{
+    // The status bar tells about file names while those are shown.
+    if (fileNamesAction->isChecked())
+        return;
+    timelineButton->setEnabled(session && (session->state() == SearchSession::Finished || session->state() == SearchSession::Failed));
+    statusBar->setToolTip(QString());
+    switch (session ? session->state() : SearchSession::Idle) {
+    case SearchSession::Idle:
+        resetStatusMessage();
+        break;
+    case SearchSession::Running:
+        statusBar->showMessage(tr("Searching..."));
+        break;
+    case SearchSession::Finished: {
+        auto seconds = QString::number(session->nanos() / 1000000000.0, 'f', 6);
+        auto results = session->found() == 1 ? tr("result") : tr("results");
+        statusBar->showMessage(tr("Found %1 %2 in %3 seconds.").arg(session->found()).arg(results).arg(seconds));
+        updateWatchUsage();
+        break;
+    }
+    case SearchSession::Failed:
+        statusBar->showMessage(session->error().isEmpty() ? tr("Search failed.") : tr("Search failed: %1").arg(session->error()));
+        updateWatchUsage();
+        break;
+    }
 }
 
-void RipgrepSearchViewPrivate::watchResultFile(const QString &file)
+void RipgrepSearchViewPrivate::updateWatchUsage()
 {
-    if (fileWatcher && !fileWatcher->files().contains(file))
-        fileWatcher->addPath(file);
+    auto usage = engine->watchUsage();
+    if (usage.files == 0)
+        return;
+    auto watches = usage.fileWatches + usage.directoryWatches + usage.listedDirectories;
+    // clang-format off
+    statusBar->setToolTip(tr("Watching %1 files for changes: %2 file watches, %3 directory watches, %4 polled.<br/>"
+                             "Watching %5 directories for file lists.<br/>"
+                             "Using %6 of %7 inotify watches (%8%).")
+        .arg(usage.files).arg(usage.fileWatches).arg(usage.directoryWatches).arg(usage.polledFiles)
+        .arg(usage.listedDirectories)
+        .arg(watches).arg(usage.budget).arg(usage.budget > 0 ? watches * 100 / usage.budget : 0));
+    // clang-format on
 }
 
-void RipgrepSearchViewPrivate::clearWatches()
+// The timings of the last search, read when asked for: painting keeps adding
+// to them while its results are scrolled through.
+void RipgrepSearchViewPrivate::showTimeline()
 {
-    if (fileWatcher && !fileWatcher->files().isEmpty())
-        fileWatcher->removePaths(fileWatcher->files());
+    if (!session)
+        return;
+    QMenu menu;
+    auto label = new QLabel(session->timeline()->summary());
+    label->setMargin(toolView->style()->pixelMetric(QStyle::PM_LayoutLeftMargin));
+    label->setTextInteractionFlags(Qt::TextSelectableByMouse);
+    auto labelAction = new QWidgetAction(&menu);
+    labelAction->setDefaultWidget(label);
+    menu.addAction(labelAction);
+    menu.addSeparator();
+    menu.addAction(QIcon::fromTheme("document-export"), tr("Export Chrome Trace..."), this, &RipgrepSearchViewPrivate::exportTimeline);
+    menu.exec(timelineButton->mapToGlobal(QPoint(0, -menu.sizeHint().height())));
 }
 
-void RipgrepSearchViewPrivate::scheduleResearch()
+void RipgrepSearchViewPrivate::exportTimeline()
 {
-    if (rgAvailable && !searchBox->currentText().isEmpty())
-        researchTimer->start();
+    if (!session)
+        return;
+    auto path = QFileDialog::getSaveFileName(toolView, tr("Export Search Trace"), QStringLiteral("ripgrep-search-trace.json"), tr("Chrome trace (*.json)"));
+    if (path.isEmpty())
+        return;
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(session->timeline()->toChromeTrace()) < 0) {
+        statusBar->showMessage(tr("Could not write %1: %2").arg(path, file.errorString()));
+        return;
+    }
+    statusBar->showMessage(tr("Search trace written to %1.").arg(path));
+}
+
+ResultExporter *RipgrepSearchViewPrivate::createExporter(const QString &caption)
+{
+    // clang-format off
+    const QStringList filters{tr("Text, grep style (*.txt)"),
+                              tr("JSON Lines (*.jsonl)"),
+                              tr("SARIF (*.sarif)")};
+    // clang-format on
+    QString filter = filters.first();
+    auto path = QFileDialog::getSaveFileName(toolView, caption, QStringLiteral("ripgrep-results.txt"), filters.join(QStringLiteral(";;")), &filter);
+    if (path.isEmpty())
+        return nullptr;
+
+    // The format follows the suffix when it names one, the chosen filter otherwise.
+    auto format = ResultExporter::formatForPath(path);
+    if (format == ResultExporter::Grep && QFileInfo(path).suffix().toLower() != QLatin1String("txt"))
+        format = ResultExporter::Format(std::max<qsizetype>(0, filters.indexOf(filter)));
+
+    auto exporter = new ResultExporter(path, format, this);
+    connect(exporter, &ResultExporter::finished, this, [this, exporter](qint64 count, qint64 skipped, const QString &error) {
+        if (error.isEmpty() && skipped > 0)
+            statusBar->showMessage(tr("Exported %1 results to %2, leaving out %3 in files changed since.").arg(count).arg(exporter->path()).arg(skipped));
+        else if (error.isEmpty())
+            statusBar->showMessage(tr("Exported %1 results to %2.").arg(count).arg(exporter->path()));
+        else
+            statusBar->showMessage(tr("Could not write %1: %2").arg(exporter->path(), error));
+        exporter->deleteLater();
+    });
+    return exporter;
+}
+
+// Writes the results shown; the view stays responsive while they are written.
+void RipgrepSearchViewPrivate::exportResults()
+{
+    if (!ensureUi())
+        return;
+    if (resultsModel->store()->matchCount() == 0) {
+        statusBar->showMessage(tr("No results to export."));
+        return;
+    }
+    auto exporter = createExporter(tr("Export Results"));
+    if (!exporter)
+        return;
+    statusBar->showMessage(tr("Writing %1...").arg(exporter->path()));
+    exporter->addStore(*resultsModel->store());
+    exporter->finish();
+}
+
+// Runs the search and streams its results to a file without showing them,
+// for result sets too large to be worth building a view of.
+void RipgrepSearchViewPrivate::exportSearch()
+{
+    if (!ensureUi())
+        return;
+    auto term = searchBox->currentText();
+    if (term.isEmpty() || !engine)
+        return;
+    auto exporter = createExporter(tr("Search and Export Results"));
+    if (!exporter)
+        return;
+
+    // An unfinished export-only search is abandoned, leaving its file as it was.
+    delete exportRun;
+    exportRun = exporter;
+    if (!exportCommand) {
+        exportCommand = new RipgrepCommand(this);
+        exportCommand->setScheduler(engine->scheduler());
+    }
+    connect(exportCommand, &RipgrepCommand::matchFound, exporter, &ResultExporter::addMatch);
+    connect(exportCommand, &RipgrepCommand::searchFinished, exporter, [this, exporter](int found) {
+        // The exporter reports once it has written everything.
+        statusBar->showMessage(tr("Found %1 results, writing %2...").arg(found).arg(exporter->path()));
+        disconnect(exportCommand, nullptr, exporter, nullptr);
+        exporter->finish();
+        exportRun = nullptr;
+    });
+    connect(exportCommand, &RipgrepCommand::searchFailed, exporter, [this, exporter](const QString &message) {
+        statusBar->showMessage(message.isEmpty() ? tr("Search failed.") : tr("Search failed: %1").arg(message));
+        exporter->deleteLater();
+    });
+
+    if (!searchRequest(term, searchDirs()).start(exportCommand)) {
+        qInfo() << "No opened documents, not performing searching.";
+        delete exportRun;
+        resetStatusMessage();
+        return;
+    }
+    statusBar->showMessage(tr("Searching, exporting to %1...").arg(exporter->path()));
 }
 
 QString RipgrepSearchViewPrivate::projectBaseDir()
@@ -384,11 +784,52 @@ QString RipgrepSearchViewPrivate::projectBaseDir()
     return QString();
 }
 
+// The project directories to search: the current project's, or those of all
+// projects, bar the ones inside another.
+QStringList RipgrepSearchViewPrivate::searchDirs()
+{
+    auto projectPlugin = mainWindow->pluginView("kateprojectplugin");
+    if (!projectPlugin)
+        return {};
+    if (allProjectsAction->isChecked()) {
+        const auto dirs = projectPlugin->property("allProjects").toMap().keys();
+        if (!dirs.isEmpty())
+            return RipgrepCommand::nestedDirsRemoved(dirs);
+    }
+    const auto dir = projectBaseDir();
+    return dir.isEmpty() ? QStringList() : QStringList{dir};
+}
+
+// The files the project plugin already knows of, from git ls-files or the
+// project file itself, for all projects or the current one. Searching these
+// saves rg walking the tree and reading its ignore files. Empty when the
+// plugin lists none, and the tree is walked after all.
+QStringList RipgrepSearchViewPrivate::projectFiles()
+{
+    auto projectPlugin = mainWindow->pluginView("kateprojectplugin");
+    if (!projectPlugin)
+        return {};
+    const auto files = projectPlugin->property(allProjectsAction->isChecked() ? "allProjectsFiles" : "projectFiles").toStringList();
+    // The files of a nested project are listed by the project around it too.
+    QStringList result;
+    result.reserve(files.size());
+    QSet<QString> seen;
+    for (const auto &file : files) {
+        if (!seen.contains(file)) {
+            seen.insert(file);
+            result.append(file);
+        }
+    }
+    return result;
+}
+
 QStringList RipgrepSearchViewPrivate::openedFiles()
 {
     QStringList result;
     auto editor = KTextEditor::Editor::instance();
     for (auto doc : editor->documents()) {
+        if (searchUnsavedAction->isChecked() && doc->isModified())
+            continue; // searched in memory instead, see unsavedBuffers()
         if (doc->url().isLocalFile()) {
             auto fileName = doc->url().toLocalFile();
             if (QFileInfo::exists(fileName))
@@ -398,61 +839,78 @@ QStringList RipgrepSearchViewPrivate::openedFiles()
     return result;
 }
 
-// ripgrep counts line breaks on '\n' only, while Kate also breaks on a lone
-// '\r' (and on "\r\n"). Re-derive the byte offset of every Kate line start so a
-// match's absolute byte offset can be turned into the cursor Kate actually uses.
-// The scan reads the whole file once; the result is cached per file for the
-// lifetime of the current search.
-const QList<qint64> &RipgrepSearchViewPrivate::lineStartsFor(const QString &file)
-{
-    if (auto it = lineStartCache.constFind(file); it != lineStartCache.constEnd())
-        return it.value();
-
-    QList<qint64> starts{0};
-    QFile f(file);
-    if (f.open(QIODevice::ReadOnly)) {
-        const QByteArray bytes = f.readAll();
-        const int n = bytes.size();
-        for (int i = 0; i < n; ++i) {
-            const char c = bytes.at(i);
-            if (c == '\n') {
-                starts.append(i + 1);
-            } else if (c == '\r') {
-                if (i + 1 < n && bytes.at(i + 1) == '\n')
-                    ++i; // "\r\n" is a single Kate line break
-                starts.append(i + 1);
-            }
+// Documents whose contents ripgrep cannot read from disk: modified documents,
+// untitled ones and remote ones. In a project search only modified documents
+// inside the project are relevant. Nothing is saved; the text is handed to
+// ripgrep through its stdin.
+QList<SearchBuffer> RipgrepSearchViewPrivate::unsavedBuffers(const QStringList &baseDirs, QHash<QString, QPointer<KTextEditor::Document>> *documents)
+{
+    QList<SearchBuffer> result;
+    if (!searchUnsavedAction->isChecked())
+        return result;
+
+    auto editor = KTextEditor::Editor::instance();
+    for (auto doc : editor->documents()) {
+        const auto url = doc->url();
+        QString label;
+        if (url.isLocalFile()) {
+            if (!doc->isModified())
+                continue;
+            label = url.toLocalFile();
+            const bool inside = std::any_of(baseDirs.cbegin(), baseDirs.cend(), [&label](const QString &baseDir) {
+                return label.startsWith(QDir(baseDir).absolutePath() + QLatin1Char('/'));
+            });
+            if (!baseDirs.isEmpty() && !inside)
+                continue;
+        } else if (baseDirs.isEmpty()) {
+            label = url.isEmpty() ? doc->documentName() : url.toDisplayString();
+            for (int i = 2; documents->contains(label); ++i)
+                label = QStringLiteral("%1 (%2)").arg(url.isEmpty() ? doc->documentName() : url.toDisplayString()).arg(i);
+        } else {
+            continue;
         }
+        documents->insert(label, doc);
+        result.append({label, doc->text().toUtf8()});
     }
-    return lineStartCache.insert(file, std::move(starts)).value();
+    return result;
 }
 
-// Map a match's absolute byte range to the Kate range to select. The match is
-// kept on a single line: should it straddle a lone '\r' (one ripgrep line, but
-// several Kate lines) the selection is clamped to the end of its start line.
+// Map a match's absolute byte range to the Kate range to select. Both ends are
+// placed through the line-start index, so a multiline match (or one straddling
+// a lone '\r', which is one ripgrep line but several Kate lines) spans exactly
+// the Kate lines it covers.
 KTextEditor::Range RipgrepSearchViewPrivate::mapToKate(const QString &file, qint64 byteStart, qint64 byteEnd, KTextEditor::Document *doc)
 {
-    const auto &starts = lineStartsFor(file);
-    auto lineOf = [&starts](qint64 offset) {
-        auto it = std::upper_bound(starts.cbegin(), starts.cend(), offset);
-        return std::max<int>(0, int(it - starts.cbegin()) - 1);
-    };
+    // ripgrep counts line breaks on '\n' only, while Kate also breaks on a lone
+    // '\r' (and on "\r\n"), so lines are found through Kate's own line starts.
+    const auto &starts = session->lineStarts(file);
     auto columnOf = [doc](int line, qint64 lineStart, qint64 offset) -> int {
         if (line < 0 || line >= doc->lines())
             return 0;
-        const QByteArray lineUtf8 = doc->line(line).toUtf8();
-        const qint64 byteInLine = qBound<qint64>(0, offset - lineStart, lineUtf8.size());
-        return int(QString::fromUtf8(lineUtf8.constData(), int(byteInLine)).size());
+        return columnAtByte(doc->line(line), offset - lineStart);
     };
 
-    const int startLine = lineOf(byteStart);
+    const int startLine = lineAtOffset(starts, byteStart);
+    const int endLine = std::max(startLine, lineAtOffset(starts, byteEnd));
     const int startColumn = columnOf(startLine, starts.at(startLine), byteStart);
-    const int endColumn = lineOf(byteEnd) == startLine ? columnOf(startLine, starts.at(startLine), byteEnd) : doc->line(startLine).size();
-    return KTextEditor::Range(startLine, startColumn, startLine, endColumn);
+    const int endColumn = columnOf(endLine, starts.at(endLine), byteEnd);
+    return KTextEditor::Range(startLine, startColumn, endLine, endColumn);
+}
+
+KTextEditor::View *RipgrepSearchViewPrivate::openResultFile(const QString &file)
+{
+    if (auto doc = session ? session->bufferDocument(file) : nullptr)
+        return mainWindow->activateView(doc);
+    return mainWindow->openUrl(QUrl::fromLocalFile(file));
 }
 
 KTextEditor::Document *RipgrepSearchViewPrivate::documentForFile(const QString &file, bool *wasOpen)
 {
+    if (auto doc = session ? session->bufferDocument(file) : nullptr) {
+        if (wasOpen)
+            *wasOpen = true;
+        return doc;
+    }
     auto editor = KTextEditor::Editor::instance();
     auto url = QUrl::fromLocalFile(file);
     for (auto doc : editor->documents()) {
@@ -475,7 +933,7 @@ KTextEditor::Document *RipgrepSearchViewPrivate::documentForFile(const QString &
 void RipgrepSearchViewPrivate::updateReplaceState()
 {
     if (replaceAllButton)
-        replaceAllButton->setEnabled(resultsModel && resultsModel->invisibleRootItem()->rowCount() > 0);
+        replaceAllButton->setEnabled(resultsModel && resultsModel->rowCount() > 0);
 }
 
 void RipgrepSearchViewPrivate::replaceAll()
@@ -498,6 +956,8 @@ void RipgrepSearchViewPrivate::replaceAll()
         auto doc = documentForFile(it.key(), &wasOpen);
         if (!doc)
             continue;
+        // Never save on the user's behalf what they had not saved themselves.
+        const bool wasModified = doc->isModified();
 
         // Resolve every match to a Kate range while the document is still
         // pristine (mapToKate reads the unedited line text for its columns).
@@ -515,7 +975,8 @@ void RipgrepSearchViewPrivate::replaceAll()
             doc->replaceText(range, replacement);
             replaced++;
         }
-        doc->save();
+        if (!wasModified)
+            doc->save();
         if (!wasOpen)
             doc->deleteLater();
     }
@@ -532,41 +993,193 @@ inline static QStringList commaSeparated(const QString &line)
     return result;
 }
 
+QString RipgrepSearchViewPrivate::searchQuery(const QString &term, const QStringList &baseDirs) const
+{
+    // clang-format off
+    return QStringList{term,
+                       QString::number(wholeWordAction->isChecked()),
+                       QString::number(caseSensitiveAction->isChecked()),
+                       QString::number(useRegexAction->isChecked()),
+                       QString::number(multilineAction->isChecked()),
+                       includeFileBox->currentText(),
+                       excludeFileBox->currentText(),
+                       QString::number(searchUnsavedAction->isChecked()),
+                       QString::number(contextBeforeBox->value()),
+                       QString::number(contextAfterBox->value()),
+                       QString::number(projectFileListAction->isChecked()),
+                       baseDirs.join(QChar(1))}.join(QChar(0));
+    // clang-format on
+}
+
+SearchRequest RipgrepSearchViewPrivate::searchRequest(const QString &term, const QStringList &baseDirs)
+{
+    SearchRequest request;
+    request.term = term;
+    request.includeFiles = commaSeparated(includeFileBox->currentText());
+    request.excludeFiles = commaSeparated(excludeFileBox->currentText());
+    const GlobFilter globs(request.includeFiles, request.excludeFiles);
+    const auto listed = baseDirs.isEmpty() ? QStringList() : projectFiles();
+    if (baseDirs.isEmpty())
+        request.files = openedFiles();
+    else if (projectFileListAction->isChecked())
+        request.files = globs.filtered(listed);
+
+    // rg reads the buffers from its stdin, where neither the globs nor ignore
+    // files apply, so they are filtered here: by the globs, and in a project by
+    // its file list (which leaves out the files it ignores).
+    const auto buffers = unsavedBuffers(baseDirs, &request.bufferDocuments);
+    QStringList labels;
+    for (const auto &buffer : buffers)
+        labels.append(buffer.label);
+    const auto matching = globs.filtered(labels);
+    const QSet<QString> kept(matching.cbegin(), matching.cend());
+    const QSet<QString> listedFiles(listed.cbegin(), listed.cend());
+    for (const auto &buffer : buffers) {
+        if (kept.contains(buffer.label) && (listedFiles.isEmpty() || listedFiles.contains(buffer.label)))
+            request.buffers.append(buffer);
+        else
+            request.bufferDocuments.remove(buffer.label);
+    }
+    // Without a list to go by, rg walks the directories itself.
+    if (!baseDirs.isEmpty() && request.files.isEmpty())
+        request.baseDirs = baseDirs;
+    request.wholeWord = wholeWordAction->isChecked();
+    request.caseSensitive = caseSensitiveAction->isChecked();
+    request.useRegex = useRegexAction->isChecked();
+    request.multiline = multilineAction->isChecked();
+    request.contextBefore = contextBeforeBox->value();
+    request.contextAfter = contextAfterBox->value();
+    return request;
+}
+
 void RipgrepSearchViewPrivate::startSearch()
 {
+    if (!ensureUi())
+        return;
+    contextTimer->stop();
+    if (fileNamesAction->isChecked()) {
+        searchFileNames();
+        return;
+    }
     auto term = searchBox->currentText();
-    if (term.isEmpty())
+    if (term.isEmpty() || !engine)
         return;
 
-    rg->setIncludeFiles(commaSeparated(includeFileBox->currentText()));
-    rg->setExcludeFiles(commaSeparated(excludeFileBox->currentText()));
-
-    QCoreApplication::removePostedEvents(resultsModel, QEvent::MetaCall);
-
-    // A pending debounced re-search is now subsumed by this run; the watch list
-    // is rebuilt as the fresh results stream back in via watchResultFile().
-    if (researchTimer)
-        researchTimer->stop();
-    clearWatches();
-    // Results are about to be rebuilt against the current on-disk contents, so
-    // any cached line-start maps (a file may have changed) are now stale.
-    lineStartCache.clear();
-
-    statusBar->showMessage(tr("Searching..."));
-    resultsModel->clear();
-    if (auto baseDir = projectBaseDir(); !baseDir.isEmpty()) {
-        rg->searchInDir(term, baseDir);
-    } else if (auto files = openedFiles(); !files.isEmpty()) {
-        rg->searchInFiles(term, files);
+    const auto baseDirs = searchDirs();
+    const auto request = searchRequest(term, baseDirs);
+    auto next = engine->acquire(searchQuery(term, baseDirs));
+    if (next == session) {
+        engine->release(next);
     } else {
+        if (tabs.at(tabBar->currentIndex()).pinned)
+            addTab();
+        attach(next, term);
+        // A search another window (or tab) has run, or is running, or one
+        // that ran recently, is shown as it is rather than run a second time.
+        if (session->resume(request))
+            return;
+    }
+
+    if (!session->run(request)) {
         qInfo() << "No opened documents, not performing searching.";
+        resetStatusMessage();
+    }
+}
+
+void RipgrepSearchViewPrivate::refresh()
+{
+    if (!ensureUi())
+        return;
+    // The file list keeps itself up to date; this is for what its watches
+    // missed.
+    if (fileNamesAction->isChecked()) {
+        if (fileList)
+            fileList->refresh();
+        searchFileNames();
+        return;
+    }
+    startSearch();
+}
+
+void RipgrepSearchViewPrivate::setFileNameMode(bool enabled)
+{
+    if (!ensureUi())
+        return;
+    // The content options mean nothing for file names, which are matched
+    // fuzzily.
+    for (auto action : {wholeWordAction, caseSensitiveAction, useRegexAction, multilineAction, searchUnsavedAction})
+        action->setEnabled(!enabled);
+    resultsStack->setCurrentWidget(enabled ? static_cast<QWidget *>(fileNameList) : resultsView);
+    searchBox->lineEdit()->setPlaceholderText(enabled ? tr("File name") : tr("Search (⇵ for history)"));
+    if (enabled) {
+        searchFileNames();
+    } else {
+        if (fileList)
+            disconnect(fileList, nullptr, this, nullptr);
+        fileList = nullptr;
+        showSessionState();
     }
 }
 
+// Matches the term against the file list of the project, which the engine
+// keeps in memory, so that every keystroke is answered without running rg.
+void RipgrepSearchViewPrivate::searchFileNames()
+{
+    if (!ensureUi() || !engine)
+        return;
+    fileNameList->clear();
+    const auto baseDir = projectBaseDir();
+    if (baseDir.isEmpty()) {
+        statusBar->showMessage(tr("File names are searched in the project; there is none open."));
+        return;
+    }
+
+    auto list = engine->fileList(baseDir);
+    if (list != fileList) {
+        if (fileList)
+            disconnect(fileList, nullptr, this, nullptr);
+        fileList = list;
+        // Matched again whenever the files change.
+        connect(list, &FileListCache::updated, this, &RipgrepSearchViewPrivate::searchFileNames);
+        connect(list, &FileListCache::failed, this, [this](const QString &message) {
+            statusBar->showMessage(tr("Could not list the files: %1").arg(message));
+        });
+    }
+    if (!list->isReady()) {
+        statusBar->showMessage(tr("Listing the files of %1...").arg(baseDir));
+        return;
+    }
+
+    const auto term = searchBox->currentText();
+    if (term.trimmed().isEmpty()) {
+        statusBar->showMessage(tr("%1 files listed.").arg(list->count()));
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    // Enough to pick from; typing more beats scrolling.
+    constexpr int maxShown = 500;
+    int total = 0;
+    const GlobFilter globs(commaSeparated(includeFileBox->currentText()), commaSeparated(excludeFileBox->currentText()));
+    const auto matches = list->match(term, globs, maxShown, &total);
+    const QDir root(list->root());
+    for (const auto &match : matches) {
+        auto item = new QListWidgetItem(match.file, fileNameList);
+        const auto path = root.filePath(match.file);
+        item->setData(Qt::UserRole, path);
+        item->setToolTip(path);
+    }
+    if (!matches.isEmpty())
+        fileNameList->setCurrentRow(0);
+    statusBar->showMessage(tr("%1 of %2 files match, in %3 ms.").arg(total).arg(list->count()).arg(timer.elapsed()));
+}
+
 void RipgrepSearchViewPrivate::searchSelection()
 {
     if (!toolView->isVisible())
         mainWindow->showToolView(toolView);
+    if (!ensureUi())
+        return;
 
     if (auto view = mainWindow->activeView(); view && view->selection()) {
         auto selectionText = view->selectionText().trimmed();
@@ -578,16 +1191,16 @@ void RipgrepSearchViewPrivate::searchSelection()
 
 void RipgrepSearchViewPrivate::clearResults()
 {
+    if (!ensureUi())
+        return;
     searchBox->clear();
     replaceBox->clear();
     includeFileBox->clear();
     excludeFileBox->clear();
-    if (researchTimer)
-        researchTimer->stop();
-    clearWatches();
-    lineStartCache.clear();
-    resultsModel->clear();
-    resetStatusMessage();
+    delete exportRun;
+    while (tabs.size() > 1)
+        closeTab(tabs.size() - 1);
+    closeTab(0);
 }
 
 #include "RipgrepSearchView.moc"
@@ -0,0 +1,515 @@
+#include "SearchEngine.hpp"
+#include "FileListCache.hpp"
+#include "LineIndex.hpp"
+#include "SearchResultsModel.hpp"
+#include "SearchScheduler.hpp"
+
+#include <KTextEditor/Document>
+
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QSet>
+#include <QThread>
+#include <QTimer>
+
+#include <functional>
+
+// How many finished searches no window shows are kept, and how much memory
+// their results may take at most.
+static constexpr int maxKeptSessions = 8;
+static constexpr qint64 maxKeptBytes = 256 * 1024 * 1024;
+// How many file lists are kept; each watches the directories of its tree.
+static constexpr int maxFileLists = 4;
+// How many results of a search hold their line text; the rest read it back
+// from the file when shown.
+static constexpr int maxKeptTexts = 5000;
+
+// What a file looked like when a search last searched it.
+struct FileFingerprint {
+    qint64 modified = -1;
+    qint64 size = -1;
+
+    bool operator==(const FileFingerprint &other) const
+    {
+        return modified == other.modified && size == other.size;
+    }
+};
+
+static FileFingerprint fingerprintOf(const QString &file)
+{
+    const QFileInfo info(file);
+    if (!info.exists())
+        return {};
+    return {info.lastModified().toMSecsSinceEpoch(), info.size()};
+}
+
+bool SearchRequest::start(RipgrepCommand *command) const
+{
+    if (baseDirs.isEmpty() && files.isEmpty() && buffers.isEmpty())
+        return false;
+
+    command->setWholeWord(wholeWord);
+    command->setCaseSensitive(caseSensitive);
+    command->setUseRegex(useRegex);
+    command->setMultiline(multiline);
+    command->setContextLines(contextBefore, contextAfter);
+    command->setIncludeFiles(includeFiles);
+    command->setExcludeFiles(excludeFiles);
+    command->setBuffers(buffers);
+    command->setBackground(background);
+    if (!baseDirs.isEmpty())
+        command->searchInDirs(term, baseDirs);
+    else
+        command->searchInFiles(term, files);
+    return true;
+}
+
+class SearchEnginePrivate
+{
+public:
+    void watch(SearchSession *session, const QString &file);
+    void unwatch(SearchSession *session);
+    void fileChanged(const QString &file);
+    void keep(SearchSession *session);
+    void discard(SearchSession *session);
+    // Fingerprints files off the GUI thread and hands them to done, unless the
+    // session is gone or has been run again meanwhile.
+    void fingerprint(SearchSession *session, const QStringList &files, std::function<void(const QHash<QString, FileFingerprint> &)> done);
+
+    SearchEngine *q;
+    QHash<QString, SearchSession *> sessions;
+    // Finished sessions no window shows, least recently shown first.
+    QList<SearchSession *> kept;
+    FileWatchManager *watcher = nullptr;
+    SearchScheduler *scheduler = nullptr;
+    // How many sessions have results in each watched file.
+    QHash<QString, int> watchCount;
+    // Line starts of files on disk. A file's are dropped when it changes or
+    // when no session has results in it any more.
+    LineIndexCache lineStarts;
+    // By root, least recently asked for first.
+    QList<QPair<QString, FileListCache *>> fileLists;
+    QThread fingerprintThread;
+    QObject *fingerprinter = nullptr;
+};
+
+class SearchSessionPrivate
+{
+public:
+    SearchSession *q;
+    SearchEngine *engine;
+    QString query;
+    int refs = 0;
+    RipgrepCommand *command = nullptr;
+    SearchResultsModel *model = nullptr;
+    QTimer *researchTimer = nullptr;
+    SearchSession::State state = SearchSession::Idle;
+    int found = 0;
+    qint64 nanos = 0;
+    QString error;
+    // What the last (full) run searched for.
+    SearchRequest request;
+    // The files a search over a list of files covered, with results or
+    // without, as they were just before it searched them. Empty after a walk.
+    QHash<QString, FileFingerprint> fingerprints;
+    // Those of the current run, taken over once it finishes.
+    QHash<QString, FileFingerprint> pendingFingerprints;
+    // Bumped by every run, so that fingerprints taken for an earlier one are
+    // not used.
+    int generation = 0;
+    // Kept by the engine while no window shows it; see SearchEngine::release().
+    bool kept = false;
+    // Taken up again after being kept: its files were not watched meanwhile.
+    bool revived = false;
+    // The current run searches the files that changed only.
+    bool rescan = false;
+    // The files this session's results are in that are being watched.
+    QSet<QString> watched;
+    // What the last run searched from memory, by label.
+    QHash<QString, QPointer<KTextEditor::Document>> bufferDocuments;
+    QHash<QString, QList<qint64>> bufferLineStarts;
+};
+
+void SearchEnginePrivate::watch(SearchSession *session, const QString &file)
+{
+    // Untitled and remote buffers have no file on disk to watch.
+    if (session->d->bufferLineStarts.contains(file) && !QDir::isAbsolutePath(file))
+        return;
+    if (session->d->watched.contains(file))
+        return;
+    session->d->watched.insert(file);
+    if (watchCount[file]++ == 0)
+        watcher->watch(file);
+}
+
+void SearchEnginePrivate::unwatch(SearchSession *session)
+{
+    for (const auto &file : std::as_const(session->d->watched)) {
+        auto it = watchCount.find(file);
+        if (--it.value() > 0)
+            continue;
+        watchCount.erase(it);
+        lineStarts.remove(file);
+        watcher->unwatch(file);
+    }
+    session->d->watched.clear();
+}
+
+void SearchEnginePrivate::keep(SearchSession *session)
+{
+    session->d->researchTimer->stop();
+    session->d->kept = true;
+    kept.append(session);
+
+    qint64 bytes = 0;
+    for (auto other : std::as_const(kept))
+        bytes += other->d->model->store()->memoryUsage();
+    while (kept.size() > maxKeptSessions || (bytes > maxKeptBytes && !kept.isEmpty())) {
+        auto oldest = kept.takeFirst();
+        bytes -= oldest->d->model->store()->memoryUsage();
+        discard(oldest);
+    }
+}
+
+void SearchEnginePrivate::discard(SearchSession *session)
+{
+    sessions.remove(session->d->query);
+    // This may well be called from one of the session's own signals.
+    session->d->researchTimer->stop();
+    session->d->command->disconnect();
+    session->deleteLater();
+}
+
+void SearchEnginePrivate::fingerprint(SearchSession *session, const QStringList &files, std::function<void(const QHash<QString, FileFingerprint> &)> done)
+{
+    QPointer<SearchSession> target(session);
+    const int generation = session->d->generation;
+    QMetaObject::invokeMethod(
+        fingerprinter,
+        [this, target, generation, files, done]() {
+            QHash<QString, FileFingerprint> fingerprints;
+            fingerprints.reserve(files.size());
+            for (const auto &file : files)
+                fingerprints.insert(file, fingerprintOf(file));
+            QMetaObject::invokeMethod(
+                q,
+                [target, generation, fingerprints, done]() {
+                    if (target && target->d->generation == generation)
+                        done(fingerprints);
+                },
+                Qt::QueuedConnection);
+        },
+        Qt::QueuedConnection);
+}
+
+void SearchEnginePrivate::fileChanged(const QString &file)
+{
+    lineStarts.remove(file);
+    for (auto session : std::as_const(sessions)) {
+        // Coalesce bursts of notifications (atomic saves delete-and-recreate
+        // the file, firing several changes) into a single re-search.
+        if (session->d->watched.contains(file))
+            session->d->researchTimer->start();
+    }
+}
+
+SearchSession::SearchSession(SearchEngine *engine)
+    : QObject(engine)
+    , d(new SearchSessionPrivate)
+{
+    d->q = this;
+    d->engine = engine;
+    d->command = new RipgrepCommand(this);
+    d->command->setScheduler(engine->d->scheduler);
+    d->model = new SearchResultsModel(this);
+    d->model->setTimeline(d->command->timeline());
+    d->model->store()->setTextBudget(maxKeptTexts);
+
+    d->researchTimer = new QTimer(this);
+    d->researchTimer->setSingleShot(true);
+    d->researchTimer->setInterval(300);
+    connect(d->researchTimer, &QTimer::timeout, this, &SearchSession::refresh);
+
+    connect(d->command, &RipgrepCommand::matchFoundInFile, d->model, &SearchResultsModel::addMatchedFile);
+    connect(d->command, &RipgrepCommand::matchFoundInFile, this, [this](const QString &file) {
+        d->engine->d->watch(this, file);
+    });
+    connect(d->command, &RipgrepCommand::matchFound, d->model, &SearchResultsModel::addMatched);
+    connect(d->command, &RipgrepCommand::contextFound, d->model, &SearchResultsModel::addContext);
+    connect(d->command, &RipgrepCommand::searchFinished, this, [this](int found, qint64 nanos) {
+        d->model->endMerge();
+        // Every listed file was fingerprinted before rg searched it, so that
+        // one which gains a match is searched by resume() too, even when it
+        // changed while rg ran. The files of a walk are not known (rg reports
+        // those with results only); resume() walks again instead.
+        d->fingerprints = std::exchange(d->pendingFingerprints, {});
+        d->state = Finished;
+        // What rg found in the changed files alone is not what there is.
+        d->found = d->rescan ? d->model->store()->matchCount() : found;
+        d->rescan = false;
+        d->nanos = nanos;
+        emit finished(d->found, nanos);
+    });
+    connect(d->command, &RipgrepCommand::searchFailed, this, [this](const QString &message) {
+        // Keep whatever was shown before; a partial run is not worth merging.
+        d->state = Failed;
+        d->rescan = false;
+        d->error = message;
+        emit failed(message);
+    });
+}
+
+SearchSession::~SearchSession() = default;
+
+SearchResultsModel *SearchSession::model() const
+{
+    return d->model;
+}
+
+SearchTimeline *SearchSession::timeline() const
+{
+    return d->command->timeline();
+}
+
+SearchSession::State SearchSession::state() const
+{
+    return d->state;
+}
+
+int SearchSession::found() const
+{
+    return d->found;
+}
+
+qint64 SearchSession::nanos() const
+{
+    return d->nanos;
+}
+
+QString SearchSession::error() const
+{
+    return d->error;
+}
+
+KTextEditor::Document *SearchSession::bufferDocument(const QString &label) const
+{
+    return d->bufferDocuments.value(label);
+}
+
+const QList<qint64> &SearchSession::lineStarts(const QString &file)
+{
+    if (auto it = d->bufferLineStarts.constFind(file); it != d->bufferLineStarts.constEnd())
+        return it.value();
+    return d->engine->d->lineStarts.lineStarts(file);
+}
+
+bool SearchSession::run(const SearchRequest &request)
+{
+    // A pending debounced re-search is now subsumed by this run; the watches
+    // are taken again as the fresh results stream back in.
+    d->researchTimer->stop();
+    d->engine->d->unwatch(this);
+    d->request = request;
+    d->revived = false;
+    d->rescan = false;
+    ++d->generation;
+    d->pendingFingerprints.clear();
+
+    // Unsaved buffers are searched as they are in memory; their line starts are
+    // taken from that same text rather than from the stale file on disk.
+    d->bufferDocuments = request.bufferDocuments;
+    d->bufferLineStarts.clear();
+    QSet<QString> bufferFiles;
+    for (const auto &buffer : request.buffers) {
+        d->bufferLineStarts.insert(buffer.label, lineStartsOf(buffer.contents));
+        bufferFiles.insert(buffer.label);
+    }
+    d->model->store()->setBufferFiles(bufferFiles);
+
+    // The model places context rows by these counts, so it has to know them
+    // before the results come in.
+    d->model->setContextLines(request.contextBefore, request.contextAfter);
+    d->model->beginMerge();
+    QStringList files;
+    for (const auto &file : request.files) {
+        if (!bufferFiles.contains(file))
+            files.append(file);
+    }
+    if (files.isEmpty()) {
+        if (!request.start(d->command)) {
+            d->model->endMerge();
+            d->state = Idle;
+            return false;
+        }
+    } else {
+        // rg starts once the files are fingerprinted; what the last run would
+        // still report meanwhile is not wanted.
+        d->command->stop();
+        d->engine->d->fingerprint(this, files, [this, request](const QHash<QString, FileFingerprint> &fingerprints) {
+            d->pendingFingerprints = fingerprints;
+            request.start(d->command);
+        });
+    }
+    d->state = Running;
+    d->error.clear();
+    emit started();
+    return true;
+}
+
+bool SearchSession::resume(const SearchRequest &request)
+{
+    if (d->state == Running)
+        return true;
+    if (d->state != Finished)
+        return false;
+    // Shown elsewhere all along, and kept up to date there.
+    if (!d->revived)
+        return true;
+
+    d->revived = false;
+    // Results from memory have nothing to tell whether they still hold, and a
+    // search over other files is a different search.
+    if (!d->request.buffers.isEmpty() || !request.buffers.isEmpty() || request.files != d->request.files)
+        return false;
+
+    // Any file below the directories of a walk may have gained a match, or be
+    // new; the kept results show while the whole walk runs again.
+    if (d->request.files.isEmpty()) {
+        refresh();
+        return true;
+    }
+
+    // The kept results show as they are while the files are checked.
+    d->state = Running;
+    emit started();
+    d->engine->d->fingerprint(this, d->fingerprints.keys(), [this, request](const QHash<QString, FileFingerprint> &fingerprints) {
+        QSet<QString> changed;
+        QStringList existing;
+        for (auto it = d->fingerprints.cbegin(); it != d->fingerprints.cend(); ++it) {
+            const auto now = fingerprints.value(it.key());
+            if (now == it.value())
+                continue;
+            changed.insert(it.key());
+            if (now.size >= 0)
+                existing.append(it.key());
+        }
+        for (auto file : std::as_const(d->model->store()->root()->children)) {
+            if (!changed.contains(file->file))
+                d->engine->d->watch(this, file->file);
+        }
+        if (changed.isEmpty()) {
+            d->state = Finished;
+            emit finished(d->found, d->nanos);
+            return;
+        }
+
+        // Search the changed files only, merging what they have now into the
+        // results of the others. Files that are gone merely lose their results.
+        d->model->beginMerge(changed);
+        SearchRequest rescan = request;
+        rescan.baseDirs.clear();
+        rescan.files = existing;
+        if (!rescan.start(d->command)) {
+            d->model->endMerge();
+            d->fingerprints = fingerprints;
+            d->found = d->model->store()->matchCount();
+            d->state = Finished;
+            emit finished(d->found, d->nanos);
+            return;
+        }
+        d->pendingFingerprints = fingerprints;
+        d->rescan = true;
+    });
+    return true;
+}
+
+void SearchSession::refresh()
+{
+    auto request = d->request;
+    request.background = true;
+    run(request);
+}
+
+SearchEngine::SearchEngine(QObject *parent)
+    : QObject(parent)
+    , d(new SearchEnginePrivate)
+{
+    d->q = this;
+    // ripgrep only ever sees what is on disk, so the results drift out of sync
+    // the moment a matched file changes — whether Kate saves an edited document
+    // or some external tool rewrites it. Every file that produced a result is
+    // watched, once however many searches it is a result of.
+    d->watcher = new FileWatchManager(this);
+    d->scheduler = new SearchScheduler(this);
+    d->fingerprinter = new QObject;
+    d->fingerprinter->moveToThread(&d->fingerprintThread);
+    d->fingerprintThread.setObjectName(QStringLiteral("SearchEngine"));
+    d->fingerprintThread.start(QThread::LowPriority);
+    connect(d->watcher, &FileWatchManager::fileChanged, this, [this](const QString &file) {
+        d->fileChanged(file);
+    });
+}
+
+SearchEngine::~SearchEngine()
+{
+    // Fingerprints still being taken are handed to nothing.
+    d->fingerprintThread.quit();
+    d->fingerprintThread.wait();
+    delete d->fingerprinter;
+}
+
+SearchSession *SearchEngine::acquire(const QString &query)
+{
+    auto &session = d->sessions[query];
+    if (!session) {
+        session = new SearchSession(this);
+        session->d->query = query;
+    } else if (session->d->kept) {
+        d->kept.removeOne(session);
+        session->d->kept = false;
+        session->d->revived = true;
+    }
+    ++session->d->refs;
+    return session;
+}
+
+void SearchEngine::release(SearchSession *session)
+{
+    if (--session->d->refs > 0)
+        return;
+    d->unwatch(session);
+    // Results from memory may no longer hold by the time the search is asked
+    // for again, with nothing to tell.
+    if (session->d->state == SearchSession::Finished && session->d->request.buffers.isEmpty())
+        d->keep(session);
+    else
+        d->discard(session);
+}
+
+SearchScheduler *SearchEngine::scheduler() const
+{
+    return d->scheduler;
+}
+
+FileListCache *SearchEngine::fileList(const QString &root)
+{
+    for (int i = 0; i < d->fileLists.size(); ++i) {
+        if (d->fileLists.at(i).first == root) {
+            d->fileLists.move(i, d->fileLists.size() - 1);
+            return d->fileLists.last().second;
+        }
+    }
+    auto list = new FileListCache(root, d->watcher, this);
+    list->refresh();
+    d->fileLists.append({root, list});
+    // Later, as a window may be showing the oldest one's matches.
+    while (d->fileLists.size() > maxFileLists)
+        d->fileLists.takeFirst().second->deleteLater();
+    return list;
+}
+
+FileWatchManager::Usage SearchEngine::watchUsage() const
+{
+    return d->watcher->usage();
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include "FileWatchManager.hpp"
+#include "RipgrepCommand.hpp"
+
+#include <QHash>
+#include <QObject>
+#include <QPointer>
+#include <QStringList>
+
+namespace KTextEditor
+{
+class Document;
+}
+class FileListCache;
+class SearchEngine;
+class SearchEnginePrivate;
+class SearchResultsModel;
+class SearchScheduler;
+class SearchSessionPrivate;
+
+// Everything one search is run with, as collected from a window's search bar.
+struct SearchRequest {
+    QString term;
+    // The directories to walk, or none to search files and buffers only.
+    QStringList baseDirs;
+    // The files to search when there are no directories: the open documents,
+    // or the file list of the project(s).
+    QStringList files;
+    QList<SearchBuffer> buffers;
+    // The documents the buffers were taken from, by buffer label.
+    QHash<QString, QPointer<KTextEditor::Document>> bufferDocuments;
+    bool wholeWord = false;
+    bool caseSensitive = false;
+    bool useRegex = false;
+    bool multiline = false;
+    int contextBefore = 0;
+    int contextAfter = 0;
+    QStringList includeFiles;
+    QStringList excludeFiles;
+    // A re-run no one is waiting for; see RipgrepCommand::setBackground().
+    bool background = false;
+
+    // Sets command up for this search and starts it. Returns false, starting
+    // nothing, when there is nothing to search.
+    bool start(RipgrepCommand *command) const;
+};
+
+// One search and its results, shown by every window that searches for the
+// same thing. Sessions are shared through SearchEngine::acquire() and
+// release(), which count the windows using them.
+class SearchSession : public QObject
+{
+    Q_OBJECT
+public:
+    enum State {
+        Idle,
+        Running,
+        Finished,
+        Failed,
+    };
+
+    ~SearchSession();
+
+    SearchResultsModel *model() const;
+    SearchTimeline *timeline() const;
+
+    State state() const;
+    // The outcome of the last run, once it finished or failed.
+    int found() const;
+    qint64 nanos() const;
+    QString error() const;
+
+    // The document a result reported under label was searched in, if it was
+    // searched from memory.
+    KTextEditor::Document *bufferDocument(const QString &label) const;
+    // Where the lines of a result's file start: read from the buffer it was
+    // searched in, or from the file on disk.
+    const QList<qint64> &lineStarts(const QString &file);
+
+    // Runs the search (again), merging its results into the ones there are.
+    // Returns false when there was nothing to search.
+    bool run(const SearchRequest &request);
+    // Takes up the session as it is, for a window that was not showing it.
+    // Results kept from an earlier run (see SearchEngine::acquire()) are
+    // brought up to date in the background: a search over a list of files
+    // searches again only those of its files that changed since, with results
+    // or without; a walk of directories, whose files are not known, is run
+    // again in full. Returns false if the search has to be run afresh instead.
+    bool resume(const SearchRequest &request);
+    // Runs the last search again in the background, as happens by itself
+    // shortly after a file with results changes on disk. Buffers are searched
+    // as they were then.
+    void refresh();
+
+signals:
+    void started();
+    void finished(int found, qint64 nanos);
+    void failed(const QString &message);
+
+private:
+    friend class SearchEngine;
+    friend class SearchEnginePrivate;
+    SearchSession(SearchEngine *engine);
+    const QScopedPointer<SearchSessionPrivate> d;
+};
+
+// Runs the searches of all windows. A search asked for again while its
+// session is alive (in another window, say) is not run a second time; its
+// results are shown from the same session. The files with results are watched
+// and the line starts of files read once, whichever searches they belong to.
+//
+// The sessions of the last few finished searches no window shows any more are
+// kept as well, so that going back to one (toggling an option back, or
+// picking it from the history) shows its results at once.
+class SearchEngine : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SearchEngine(QObject *parent = nullptr);
+    ~SearchEngine();
+
+    // The session of the search identified by query: a live or kept one, or a
+    // new one. Every acquire() is to be paired with a release().
+    SearchSession *acquire(const QString &query);
+    void release(SearchSession *session);
+
+    FileWatchManager::Usage watchUsage() const;
+    // Where the rg processes of every search take turns.
+    SearchScheduler *scheduler() const;
+
+    // The files below root, for searching file names in (with whatever globs).
+    // Listed when first asked for and kept up to date from then on, out of
+    // the same watches as the results; the lists of the last few roots asked
+    // for are kept.
+    FileListCache *fileList(const QString &root);
+
+private:
+    friend class SearchSession;
+    friend class SearchSessionPrivate;
+    const QScopedPointer<SearchEnginePrivate> d;
+};
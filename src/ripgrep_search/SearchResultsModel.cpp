@@ -1,157 +1,380 @@
 #include "SearchResultsModel.hpp"
+#include "SearchTimeline.hpp"
 
 #include <KFileItem>
-#include <QFileInfo>
-#include <QStandardItemModel>
+#include <QCache>
+#include <QHash>
+#include <QIcon>
 
-struct SearchResultsModelPrivate {
-    void onItemChanged(QStandardItem *item);
-    void updateParentState(QStandardItem *parent);
+class SearchResultsModelPrivate : public ResultStoreListener
+{
+public:
+    QModelIndex indexOf(const ResultNode *node) const;
+    ResultNode *nodeOf(const QModelIndex &index) const;
+    QIcon iconFor(const QString &file) const;
+    QString matchText(const ResultNode *node) const;
+
+    void rowsAboutToBeInserted(ResultNode *parent, int first, int last) override;
+    void rowsInserted() override;
+    void rowsAboutToBeRemoved(ResultNode *parent, int first, int last) override;
+    void rowsRemoved() override;
+    void rowsChanged(ResultNode *parent, int first, int last) override;
+    void layoutAboutToBeChanged() override;
+    void layoutChanged() override;
+    void aboutToReset() override;
+    void reset() override;
+
+    void recordMemory();
 
     SearchResultsModel *q;
-    QStandardItem *currentItem = nullptr;
-    bool updatingChecks = false;
+    ResultStore store;
+    SearchTimeline *timeline = nullptr;
+    // Icons are looked up by MIME type, which is too slow to repeat on every
+    // paint.
+    mutable QHash<QString, QIcon> icons;
+    // What the match rows on screen that let go of their text read back as
+    // (null for a file that changed), so that a row reads its file once
+    // rather than for every role of every paint. Dropped with any row, and
+    // after a merge, which may have found the files changed.
+    mutable QCache<const ResultNode *, QString> texts{1000};
+    // Persistent indexes and the nodes they referred to across a layout change.
+    QModelIndexList layoutIndexes;
+    QList<const ResultNode *> layoutNodes;
 };
 
+QModelIndex SearchResultsModelPrivate::indexOf(const ResultNode *node) const
+{
+    if (node == nullptr || node->kind == ResultNode::Root)
+        return QModelIndex();
+    return q->createIndex(store.rowOf(node), 0, const_cast<ResultNode *>(node));
+}
+
+ResultNode *SearchResultsModelPrivate::nodeOf(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return store.root();
+    return static_cast<ResultNode *>(index.internalPointer());
+}
+
+QIcon SearchResultsModelPrivate::iconFor(const QString &file) const
+{
+    auto it = icons.constFind(file);
+    if (it == icons.constEnd()) {
+        KFileItem item(QUrl::fromLocalFile(file), QString(), KFileItem::Unknown);
+        it = icons.insert(file, QIcon::fromTheme(item.iconName()));
+    }
+    return it.value();
+}
+
+QString SearchResultsModelPrivate::matchText(const ResultNode *node) const
+{
+    if (node->textOffset < 0)
+        return node->text;
+    if (auto text = texts.object(node))
+        return *text;
+    auto text = new QString(store.matchText(node));
+    texts.insert(node, text);
+    return *text;
+}
+
+void SearchResultsModelPrivate::recordMemory()
+{
+    if (timeline)
+        timeline->updateMemory(store.memoryUsage());
+}
+
+void SearchResultsModelPrivate::rowsAboutToBeInserted(ResultNode *parent, int first, int last)
+{
+    q->beginInsertRows(indexOf(parent), first, last);
+}
+
+void SearchResultsModelPrivate::rowsInserted()
+{
+    q->endInsertRows();
+}
+
+void SearchResultsModelPrivate::rowsAboutToBeRemoved(ResultNode *parent, int first, int last)
+{
+    texts.clear();
+    q->beginRemoveRows(indexOf(parent), first, last);
+}
+
+void SearchResultsModelPrivate::rowsRemoved()
+{
+    q->endRemoveRows();
+}
+
+void SearchResultsModelPrivate::rowsChanged(ResultNode *parent, int first, int last)
+{
+    auto parentIndex = indexOf(parent);
+    emit q->dataChanged(q->index(first, 0, parentIndex), q->index(last, 0, parentIndex));
+}
+
+// Only the order of the files changes, so every persistent index still refers
+// to the same node afterwards and can be moved to wherever that node went.
+void SearchResultsModelPrivate::layoutAboutToBeChanged()
+{
+    emit q->layoutAboutToBeChanged({}, QAbstractItemModel::VerticalSortHint);
+    layoutIndexes = q->persistentIndexList();
+    layoutNodes.clear();
+    layoutNodes.reserve(layoutIndexes.size());
+    for (const auto &index : std::as_const(layoutIndexes))
+        layoutNodes.append(nodeOf(index));
+}
+
+void SearchResultsModelPrivate::layoutChanged()
+{
+    QModelIndexList moved;
+    moved.reserve(layoutNodes.size());
+    for (auto node : std::as_const(layoutNodes))
+        moved.append(indexOf(node));
+    q->changePersistentIndexList(layoutIndexes, moved);
+    layoutIndexes.clear();
+    layoutNodes.clear();
+    emit q->layoutChanged({}, QAbstractItemModel::VerticalSortHint);
+}
+
+void SearchResultsModelPrivate::aboutToReset()
+{
+    q->beginResetModel();
+}
+
+void SearchResultsModelPrivate::reset()
+{
+    icons.clear();
+    texts.clear();
+    q->endResetModel();
+}
+
 SearchResultsModel::SearchResultsModel(QObject *parent)
-    : QStandardItemModel(parent)
+    : QAbstractItemModel(parent)
     , d(new SearchResultsModelPrivate)
 {
     d->q = this;
-    connect(this, &QStandardItemModel::itemChanged, this, [this](QStandardItem *item) {
-        d->onItemChanged(item);
-    });
+    d->store.setListener(d.get());
 }
 
-SearchResultsModel::~SearchResultsModel() = default;
+SearchResultsModel::~SearchResultsModel()
+{
+    d->store.setListener(nullptr);
+}
 
-void SearchResultsModel::clear()
+ResultStore *SearchResultsModel::store() const
+{
+    return &d->store;
+}
+
+void SearchResultsModel::setTimeline(SearchTimeline *timeline)
 {
-    d->currentItem = nullptr;
-    QStandardItemModel::clear();
+    d->timeline = timeline;
 }
 
-void SearchResultsModelPrivate::onItemChanged(QStandardItem *item)
+QModelIndex SearchResultsModel::index(int row, int column, const QModelIndex &parent) const
 {
-    if (updatingChecks)
-        return;
-    if (!(item->flags() & Qt::ItemIsUserCheckable))
-        return;
+    auto node = d->nodeOf(parent);
+    if (column != 0 || row < 0 || row >= node->children.size())
+        return QModelIndex();
+    return createIndex(row, column, node->children.at(row));
+}
 
-    updatingChecks = true;
-    if (item->hasChildren()) {
-        // File item toggled: propagate its state to every result line below it.
-        auto state = item->checkState();
-        if (state != Qt::PartiallyChecked) {
-            for (int i = 0; i < item->rowCount(); ++i)
-                item->child(i)->setCheckState(state);
+QModelIndex SearchResultsModel::parent(const QModelIndex &child) const
+{
+    if (!child.isValid())
+        return QModelIndex();
+    return d->indexOf(d->nodeOf(child)->parent);
+}
+
+int SearchResultsModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.column() > 0)
+        return 0;
+    return d->nodeOf(parent)->children.size();
+}
+
+int SearchResultsModel::columnCount(const QModelIndex &) const
+{
+    return 1;
+}
+
+bool SearchResultsModel::hasChildren(const QModelIndex &parent) const
+{
+    return rowCount(parent) > 0;
+}
+
+QVariant SearchResultsModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid())
+        return QVariant();
+
+    const auto node = d->nodeOf(index);
+    switch (node->kind) {
+    case ResultNode::File:
+        switch (role) {
+        case Qt::DisplayRole:
+            return node->text;
+        case Qt::DecorationRole:
+            return d->iconFor(node->file);
+        case Qt::ToolTipRole:
+        case FileNameRole:
+            return node->file;
+        case Qt::CheckStateRole:
+            return node->checkState;
+        case SortKeyRole:
+            return node->sortKey;
+        case FileModifiedRole:
+            return node->modified < 0 ? QVariant() : QVariant(node->modified);
+        }
+        break;
+    case ResultNode::Match:
+        switch (role) {
+        case Qt::DisplayRole: {
+            // The text may have to be read back from the file; if the file no
+            // longer has it, say so rather than show whatever is there now.
+            const auto text = d->matchText(node);
+            return text.isNull() ? tr("(the file has changed since it was searched)") : text;
         }
-    } else if (auto parent = item->parent()) {
-        // Result line toggled: refresh the parent file's tri-state.
-        updateParentState(parent);
+        case Qt::ToolTipRole:
+            // clang-format off
+            return tr("%1<hr/>%2<br/>line %3, column %4 to %5")
+                .arg(d->matchText(node).trimmed().toHtmlEscaped())
+                .arg(node->file.toHtmlEscaped())
+                .arg(node->line).arg(node->start + 1).arg(node->end + 1);
+            // clang-format on
+        case Qt::CheckStateRole:
+            return node->checkState;
+        case FileNameRole:
+            return node->file;
+        case LineNumberRole:
+            return node->line;
+        case StartColumnRole:
+            return d->matchText(node).isNull() ? -1 : node->start;
+        case EndColumnRole:
+            return d->matchText(node).isNull() ? -1 : node->end;
+        case ByteStartRole:
+            return node->byteStart;
+        case ByteEndRole:
+            return node->byteEnd;
+        }
+        break;
+    case ResultNode::Context:
+        switch (role) {
+        case Qt::DisplayRole:
+        case ByteStartRole:
+        case ByteEndRole:
+            if (auto contextLine = d->store.contextLine(node)) {
+                if (role == Qt::DisplayRole)
+                    return contextLine->text;
+                return contextLine->byteOffset;
+            }
+            break;
+        case FileNameRole:
+            return node->file;
+        case ContextLineRole:
+            return node->line;
+        }
+        break;
+    case ResultNode::Root:
+        break;
     }
-    updatingChecks = false;
+    return QVariant();
 }
 
-void SearchResultsModelPrivate::updateParentState(QStandardItem *parent)
+bool SearchResultsModel::setData(const QModelIndex &index, const QVariant &value, int role)
 {
-    int checked = 0;
-    int total = parent->rowCount();
-    for (int i = 0; i < total; ++i) {
-        if (parent->child(i)->checkState() == Qt::Checked)
-            checked++;
-    }
-    auto state = checked == 0 ? Qt::Unchecked : (checked == total ? Qt::Checked : Qt::PartiallyChecked);
-    parent->setCheckState(state);
+    if (!index.isValid() || role != Qt::CheckStateRole)
+        return false;
+    // The store announces every row whose state changes as a result, including
+    // the file's tri-state and the matches below a toggled file.
+    d->store.setCheckState(d->nodeOf(index), Qt::CheckState(value.toInt()));
+    return true;
 }
 
-QVector<ReplacementTarget> SearchResultsModel::checkedResults() const
+Qt::ItemFlags SearchResultsModel::flags(const QModelIndex &index) const
 {
-    QVector<ReplacementTarget> result;
-    auto root = invisibleRootItem();
-    for (int i = 0; i < root->rowCount(); ++i) {
-        auto fileItem = root->child(i);
-        for (int j = 0; j < fileItem->rowCount(); ++j) {
-            auto item = fileItem->child(j);
-            if (item->checkState() == Qt::Unchecked)
-                continue;
-            result.append({
-                item->data(FileNameRole).toString(),
-                item->data(ByteStartRole).toLongLong(),
-                item->data(ByteEndRole).toLongLong(),
-            });
-        }
+    if (!index.isValid())
+        return Qt::NoItemFlags;
+    switch (d->nodeOf(index)->kind) {
+    case ResultNode::File:
+        return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsUserCheckable | Qt::ItemIsAutoTristate;
+    case ResultNode::Match:
+        return Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsUserCheckable;
+    default:
+        return Qt::ItemIsEnabled | Qt::ItemIsSelectable;
     }
-    return result;
 }
 
-void SearchResultsModel::selectAll()
+void SearchResultsModel::clear()
 {
-    // Toggling a file item cascades to its result lines via onItemChanged().
-    auto root = invisibleRootItem();
-    for (int i = 0; i < root->rowCount(); ++i)
-        root->child(i)->setCheckState(Qt::Checked);
+    d->store.clear();
 }
 
-void SearchResultsModel::deselectAll()
+void SearchResultsModel::setContextLines(int before, int after)
 {
-    auto root = invisibleRootItem();
-    for (int i = 0; i < root->rowCount(); ++i)
-        root->child(i)->setCheckState(Qt::Unchecked);
+    d->store.setContextLines(before, after);
 }
 
-void SearchResultsModel::invertSelection()
+void SearchResultsModel::beginMerge()
 {
-    // Flip each result line; the parent file tri-state is refreshed per change.
-    auto root = invisibleRootItem();
-    for (int i = 0; i < root->rowCount(); ++i) {
-        auto fileItem = root->child(i);
-        for (int j = 0; j < fileItem->rowCount(); ++j) {
-            auto item = fileItem->child(j);
-            auto next = item->checkState() == Qt::Checked ? Qt::Unchecked : Qt::Checked;
-            item->setCheckState(next);
-        }
-    }
+    d->store.beginMerge();
 }
 
-static inline QIcon iconForFile(const QString &filePath)
+void SearchResultsModel::beginMerge(const QSet<QString> &files)
 {
-    KFileItem item(QUrl::fromLocalFile(filePath), QString(), KFileItem::Unknown);
-    return QIcon::fromTheme(item.iconName());
+    d->store.beginMerge(files);
+}
+
+void SearchResultsModel::endMerge()
+{
+    d->store.endMerge();
+    d->texts.clear();
+}
+
+QVector<ReplacementTarget> SearchResultsModel::checkedResults() const
+{
+    return d->store.checkedResults();
+}
+
+SearchResultsModel::SortOrder SearchResultsModel::sortOrder() const
+{
+    return d->store.sortOrder();
+}
+
+void SearchResultsModel::setSortOrder(SortOrder order)
+{
+    d->store.setSortOrder(order);
 }
 
 void SearchResultsModel::addMatchedFile(const QString &file)
 {
-    auto icon = iconForFile(file);
-    auto text = QFileInfo(file).fileName();
-    d->currentItem = new QStandardItem(icon, text);
-    d->currentItem->setData(file, Qt::ToolTipRole);
-    d->currentItem->setData(file, FileNameRole);
-    d->currentItem->setCheckable(true);
-    d->currentItem->setAutoTristate(true);
-    d->currentItem->setCheckState(Qt::Checked);
-    invisibleRootItem()->appendRow(d->currentItem);
+    SearchTimeline::Scope scope(d->timeline, SearchTimeline::Insert);
+    d->store.addFile(file);
 }
 
 void SearchResultsModel::addMatched(const QString &file, const QString &text, int line, int start, int end, qint64 byteStart, qint64 byteEnd)
 {
-    if (d->currentItem == nullptr)
-        return;
-    auto resultItem = new QStandardItem(text);
-    // clang-format off
-    auto tooltip = tr("%1<hr/>%2<br/>line %3, column %4 to %5")
-        .arg(text.trimmed().toHtmlEscaped())
-        .arg(file.toHtmlEscaped())
-        .arg(line).arg(start + 1).arg(end + 1);
-    // clang-format on
-    resultItem->setData(tooltip, Qt::ToolTipRole);
-    resultItem->setData(file, FileNameRole);
-    resultItem->setData(line, LineNumberRole);
-    resultItem->setData(start, StartColumnRole);
-    resultItem->setData(end, EndColumnRole);
-    resultItem->setData(byteStart, ByteStartRole);
-    resultItem->setData(byteEnd, ByteEndRole);
-    resultItem->setCheckable(true);
-    resultItem->setCheckState(Qt::Checked);
-    d->currentItem->appendRow(resultItem);
+    SearchTimeline::Scope scope(d->timeline, SearchTimeline::Insert);
+    d->store.addMatch(file, text, line, start, end, byteStart, byteEnd);
+    d->recordMemory();
+}
+
+void SearchResultsModel::addContext(const QString &file, const QString &text, int line, qint64 byteOffset)
+{
+    SearchTimeline::Scope scope(d->timeline, SearchTimeline::Insert);
+    d->store.addContext(file, text, line, byteOffset);
+    d->recordMemory();
+}
+
+void SearchResultsModel::selectAll()
+{
+    d->store.selectAll();
+}
+
+void SearchResultsModel::deselectAll()
+{
+    d->store.deselectAll();
+}
+
+void SearchResultsModel::invertSelection()
+{
+    d->store.invertSelection();
 }
@@ -1,16 +1,16 @@
 #pragma once
-#include <QStandardItemModel>
+#include "ResultStore.hpp"
+
+#include <QAbstractItemModel>
 #include <QVector>
 
 class SearchResultsModelPrivate;
+class SearchTimeline;
 
-struct ReplacementTarget {
-    QString file;
-    qint64 byteStart;
-    qint64 byteEnd;
-};
-
-class SearchResultsModel : public QStandardItemModel
+// Presents a ResultStore to the views. All of the result bookkeeping lives in
+// the store (which builds without any GUI); this only turns its nodes into
+// model indexes and roles.
+class SearchResultsModel : public QAbstractItemModel
 {
     Q_OBJECT
 public:
@@ -23,22 +23,63 @@ public:
         // the Kate cursor at navigation time (see RipgrepCommand::matchFound).
         ByteStartRole,
         ByteEndRole,
+        // Set on file rows only: the key the files are ordered by (see
+        // SortOrder) and, once needed, the file's modification time.
+        SortKeyRole,
+        FileModifiedRole,
+        // Set on context rows only (the dimmed lines shown around a match): the
+        // number of the line shown. Their text and byte offset are looked up in
+        // the per-file context store rather than kept in the row.
+        ContextLineRole,
     };
 
+    using SortOrder = ResultStore::SortOrder;
+
     explicit SearchResultsModel(QObject *parent = nullptr);
     ~SearchResultsModel();
+
+    ResultStore *store() const;
+
+    // Where the time spent inserting results, and the memory they take, is
+    // recorded.
+    void setTimeline(SearchTimeline *timeline);
+
+    QModelIndex index(int row, int column, const QModelIndex &parent = QModelIndex()) const override;
+    QModelIndex parent(const QModelIndex &child) const override;
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    bool hasChildren(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    bool setData(const QModelIndex &index, const QVariant &value, int role = Qt::EditRole) override;
+    Qt::ItemFlags flags(const QModelIndex &index) const override;
+
     void clear();
 
+    // How many lines before and after each match the search reports, so that
+    // a context line can be placed below the match(es) it belongs to.
+    void setContextLines(int before, int after);
+
+    // See ResultStore: a re-run of the same search is merged into the
+    // existing rows instead of rebuilding them.
+    void beginMerge();
+    void beginMerge(const QSet<QString> &files);
+    void endMerge();
+
     QVector<ReplacementTarget> checkedResults() const;
 
+    SortOrder sortOrder() const;
+    void setSortOrder(SortOrder order);
+
 public slots:
     void addMatchedFile(const QString &file);
     void addMatched(const QString &file, const QString &text, int line, int start, int end, qint64 byteStart, qint64 byteEnd);
+    void addContext(const QString &file, const QString &text, int line, qint64 byteOffset);
 
     void selectAll();
     void deselectAll();
     void invertSelection();
 
 private:
+    friend class SearchResultsModelPrivate;
     const QScopedPointer<SearchResultsModelPrivate> d;
 };
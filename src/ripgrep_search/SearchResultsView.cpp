@@ -1,7 +1,9 @@
 #include "SearchResultsView.hpp"
 #include "SearchResultsModel.hpp"
+#include "SearchTimeline.hpp"
 
 #include <QAction>
+#include <QActionGroup>
 #include <QApplication>
 #include <QContextMenuEvent>
 #include <QFileInfo>
@@ -9,12 +11,13 @@
 #include <QMenu>
 #include <QPainter>
 #include <QPalette>
-#include <QStandardItemModel>
 #include <QStyleOptionViewItem>
 #include <QStyledItemDelegate>
 #include <QTextLayout>
 #include <QTreeView>
 
+#include <algorithm>
+
 class SearchResultsViewPrivate : public QObject
 {
     Q_OBJECT
@@ -29,8 +32,11 @@ public:
     void createActions();
     void jumpTo(const QModelIndex &index);
     QModelIndex fileIndexFor(const QModelIndex &index) const;
+    SearchResultsModel *resultsModel() const;
+    void updateSortActions();
 
     SearchResultsView *q;
+    SearchTimeline *timeline = nullptr;
     bool showCheckboxes = false;
 
     QAction *selectAllAction = nullptr;
@@ -42,6 +48,10 @@ public:
     QAction *collapseFileAction = nullptr;
     QAction *expandAllAction = nullptr;
     QAction *collapseAllAction = nullptr;
+    QAction *sortByPathAction = nullptr;
+    QAction *sortByMatchCountAction = nullptr;
+    QAction *sortByModifiedAction = nullptr;
+    QMetaObject::Connection expandConnection;
 };
 
 class SearchResultDelegate : public QStyledItemDelegate
@@ -58,6 +68,11 @@ static inline bool isMatchedLine(const QModelIndex &index)
     return role.isValid() && role.canConvert<int>();
 }
 
+static inline bool isContextLine(const QModelIndex &index)
+{
+    return index.data(SearchResultsModel::ContextLineRole).isValid();
+}
+
 static std::pair<int, QString> trimLeft(const QString &str)
 {
     auto result = str.trimmed();
@@ -68,9 +83,37 @@ static std::pair<int, QString> trimLeft(const QString &str)
     return {str.length(), result};
 }
 
+// A multiline match is shown on its single row: line breaks become a visible
+// marker (a "\r\n" pair a marker and an invisible character) so that every
+// character keeps its offset, and only the first few lines are kept.
+static QString compactPreview(const QString &text)
+{
+    constexpr int maxLines = 3;
+    QString result = text;
+    int lines = 1;
+    for (int i = 0; i < result.size(); ++i) {
+        const QChar c = result.at(i);
+        if (c != QLatin1Char('\n') && c != QLatin1Char('\r'))
+            continue;
+        if (c == QLatin1Char('\r') && i + 1 < result.size() && result.at(i + 1) == QLatin1Char('\n')) {
+            result[i] = QChar(0x200B);
+            continue;
+        }
+        if (++lines > maxLines) {
+            result.truncate(i);
+            result.append(QChar(0x2026));
+            break;
+        }
+        result[i] = QChar(0x21B5);
+    }
+    return result;
+}
+
 static QList<QTextLayout::FormatRange> highlightFormats(const QPalette &palette, int length, int start, int end)
 {
     QList<QTextLayout::FormatRange> formats;
+    // A match running past a truncated preview is highlighted up to its end.
+    end = std::min(end, length);
     if (start >= 0 && end > start && end <= length) {
         QTextCharFormat normal;
         QTextCharFormat highlight;
@@ -87,13 +130,16 @@ static QList<QTextLayout::FormatRange> highlightFormats(const QPalette &palette,
 
 void SearchResultDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
 {
+    auto view = qobject_cast<const SearchResultsView *>(option.widget);
+    auto timeline = view ? view->timeline() : nullptr;
+    SearchTimeline::Scope scope(timeline, SearchTimeline::Paint);
+
     QStyleOptionViewItem opt = option;
     initStyleOption(&opt, index);
     painter->save();
 
     // Only reserve and draw the check indicator while the replace options are
     // visible; otherwise the results read as a plain list.
-    auto view = qobject_cast<const SearchResultsView *>(opt.widget);
     if (view && !view->showCheckboxes())
         opt.features &= ~QStyleOptionViewItem::HasCheckIndicator;
 
@@ -125,12 +171,18 @@ void SearchResultDelegate::paint(QPainter *painter, const QStyleOptionViewItem &
     if (!icon.isNull())
         icon.paint(painter, iconRect, Qt::AlignCenter);
 
-    const auto &[trimmed, text] = trimLeft(index.data(Qt::DisplayRole).toString());
+    const auto &[trimmed, trimmedText] = trimLeft(index.data(Qt::DisplayRole).toString());
+    const auto text = compactPreview(trimmedText);
     int start = index.data(SearchResultsModel::StartColumnRole).toInt() - trimmed;
     int end = index.data(SearchResultsModel::EndColumnRole).toInt() - trimmed;
 
     QTextLayout layout(text, opt.font);
-    if (isMatchedLine(index)) {
+    if (isContextLine(index)) {
+        // Context is only there to be read around the matches; dim it.
+        painter->setPen(opt.palette.color(QPalette::Disabled, QPalette::Text));
+    } else if (isMatchedLine(index)) {
+        if (timeline)
+            timeline->mark(SearchTimeline::FirstResultShown);
         const auto &formats = highlightFormats(opt.palette, text.length(), start, end);
         layout.setFormats(formats);
     }
@@ -153,37 +205,74 @@ SearchResultsView::SearchResultsView(SearchResultsModel *model, QWidget *parent)
     d->moveToThread(thread());
     d->q = this;
 
-    setModel(model);
     setItemDelegate(new SearchResultDelegate(this));
     setWordWrap(false);
     setHorizontalScrollBarPolicy(Qt::ScrollBarAsNeeded);
     setUniformRowHeights(true);
     setEditTriggers(NoEditTriggers);
 
-    connect(model, &SearchResultsModel::rowsInserted, [this](const QModelIndex &parent, auto, auto) {
-        expand(parent);
-    });
-
     d->createActions();
+    setModel(model);
 }
 
 SearchResultsView::~SearchResultsView() = default;
 
-void SearchResultsViewPrivate::createActions()
+// The model changes whenever the view switches to the results of another
+// search, which may already be there in full (see SearchEngine).
+void SearchResultsView::setModel(QAbstractItemModel *model)
 {
-    auto selectionModel = qobject_cast<SearchResultsModel *>(q->model());
+    disconnect(d->expandConnection);
+    QTreeView::setModel(model);
+    if (!model)
+        return;
+
+    // Expand a file when its first results arrive, but leave files the user
+    // collapsed alone when a re-search merges further results into them.
+    d->expandConnection = connect(model, &QAbstractItemModel::rowsInserted, this, [this](const QModelIndex &parent, int first, int last) {
+        if (parent.isValid() && first == 0 && last == this->model()->rowCount(parent) - 1)
+            expand(parent);
+    });
+    if (model->rowCount() > 0)
+        expandAll();
+    d->updateSortActions();
+}
 
+SearchResultsModel *SearchResultsViewPrivate::resultsModel() const
+{
+    return qobject_cast<SearchResultsModel *>(q->model());
+}
+
+void SearchResultsViewPrivate::updateSortActions()
+{
+    if (auto model = resultsModel()) {
+        sortByPathAction->setChecked(model->sortOrder() == ResultStore::SortByPath);
+        sortByMatchCountAction->setChecked(model->sortOrder() == ResultStore::SortByMatchCount);
+        sortByModifiedAction->setChecked(model->sortOrder() == ResultStore::SortByModified);
+    }
+}
+
+void SearchResultsViewPrivate::createActions()
+{
     selectAllAction = new QAction(QIcon::fromTheme("edit-select-all"), tr("Select All"), q);
     selectAllAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_A));
-    connect(selectAllAction, &QAction::triggered, selectionModel, &SearchResultsModel::selectAll);
+    connect(selectAllAction, &QAction::triggered, this, [this] {
+        if (auto model = resultsModel())
+            model->selectAll();
+    });
 
     deselectAllAction = new QAction(QIcon::fromTheme("edit-select-none"), tr("De-select All"), q);
     deselectAllAction->setShortcut(QKeySequence(Qt::CTRL | Qt::SHIFT | Qt::Key_A));
-    connect(deselectAllAction, &QAction::triggered, selectionModel, &SearchResultsModel::deselectAll);
+    connect(deselectAllAction, &QAction::triggered, this, [this] {
+        if (auto model = resultsModel())
+            model->deselectAll();
+    });
 
     invertSelectionAction = new QAction(tr("Invert Selection"), q);
     invertSelectionAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_I));
-    connect(invertSelectionAction, &QAction::triggered, selectionModel, &SearchResultsModel::invertSelection);
+    connect(invertSelectionAction, &QAction::triggered, this, [this] {
+        if (auto model = resultsModel())
+            model->invertSelection();
+    });
 
     jumpToResultAction = new QAction(QIcon::fromTheme("go-jump"), tr("Jump to Result"), q);
     jumpToResultAction->setShortcut(QKeySequence(Qt::Key_Return));
@@ -208,6 +297,20 @@ void SearchResultsViewPrivate::createActions()
     collapseAllAction->setShortcut(QKeySequence(Qt::CTRL | Qt::Key_Minus));
     connect(collapseAllAction, &QAction::triggered, q, &QTreeView::collapseAll);
 
+    auto sortGroup = new QActionGroup(q);
+    auto addSortAction = [this, sortGroup](const QString &text, ResultStore::SortOrder order) {
+        auto action = new QAction(text, sortGroup);
+        action->setCheckable(true);
+        connect(action, &QAction::triggered, this, [this, order] {
+            if (auto model = resultsModel())
+                model->setSortOrder(order);
+        });
+        return action;
+    };
+    sortByPathAction = addSortAction(tr("Path"), ResultStore::SortByPath);
+    sortByMatchCountAction = addSortAction(tr("Number of Matches"), ResultStore::SortByMatchCount);
+    sortByModifiedAction = addSortAction(tr("Last Modified"), ResultStore::SortByModified);
+
     // Register the actions on the view so their shortcuts fire while it has
     // focus, even when the context menu is not open.
     const auto actions = {selectAllAction,
@@ -238,6 +341,16 @@ void SearchResultsView::setShowCheckboxes(bool show)
     viewport()->update();
 }
 
+SearchTimeline *SearchResultsView::timeline() const
+{
+    return d->timeline;
+}
+
+void SearchResultsView::setTimeline(SearchTimeline *timeline)
+{
+    d->timeline = timeline;
+}
+
 QRect SearchResultsViewPrivate::checkBoxRect(const QModelIndex &index) const
 {
     if (!showCheckboxes || !(index.flags() & Qt::ItemIsUserCheckable))
@@ -283,7 +396,7 @@ void SearchResultsViewPrivate::jumpTo(const QModelIndex &index)
         return;
 
     auto file = index.data(SearchResultsModel::FileNameRole).toString();
-    if (isMatchedLine(index)) {
+    if (isMatchedLine(index) || isContextLine(index)) {
         auto byteStart = index.data(SearchResultsModel::ByteStartRole).toLongLong();
         auto byteEnd = index.data(SearchResultsModel::ByteEndRole).toLongLong();
         emit q->jumpToResult(file, byteStart, byteEnd);
@@ -296,6 +409,8 @@ QModelIndex SearchResultsViewPrivate::fileIndexFor(const QModelIndex &index) con
 {
     if (!index.isValid())
         return QModelIndex();
+    if (isContextLine(index))
+        return index.parent().parent();
     return isMatchedLine(index) ? index.parent() : index;
 }
 
@@ -333,7 +448,7 @@ void SearchResultsView::contextMenuEvent(QContextMenuEvent *event)
     d->selectAllAction->setEnabled(hasResults);
     d->deselectAllAction->setEnabled(hasResults);
     d->invertSelectionAction->setEnabled(hasResults);
-    bool onMatchedLine = isMatchedLine(current);
+    bool onMatchedLine = isMatchedLine(current) || isContextLine(current);
     d->jumpToResultAction->setEnabled(onMatchedLine);
     d->jumpToFileAction->setEnabled(current.isValid());
     d->expandFileAction->setEnabled(current.isValid());
@@ -358,6 +473,12 @@ void SearchResultsView::contextMenuEvent(QContextMenuEvent *event)
     menu.addSeparator();
     menu.addAction(d->expandAllAction);
     menu.addAction(d->collapseAllAction);
+    menu.addSeparator();
+    auto sortMenu = menu.addMenu(QIcon::fromTheme("view-sort"), tr("Sort Files By"));
+    sortMenu->setEnabled(hasResults);
+    sortMenu->addAction(d->sortByPathAction);
+    sortMenu->addAction(d->sortByMatchCountAction);
+    sortMenu->addAction(d->sortByModifiedAction);
     menu.exec(event->globalPos());
 }
 
@@ -2,6 +2,7 @@
 #include <QTreeView>
 
 class SearchResultsModel;
+class SearchTimeline;
 class SearchResultsViewPrivate;
 
 class SearchResultsView : public QTreeView
@@ -11,9 +12,15 @@ public:
     explicit SearchResultsView(SearchResultsModel *model, QWidget *parent = nullptr);
     ~SearchResultsView();
 
+    void setModel(QAbstractItemModel *model) override;
+
     bool showCheckboxes() const;
     void setShowCheckboxes(bool show);
 
+    // Where the time spent painting results is recorded.
+    SearchTimeline *timeline() const;
+    void setTimeline(SearchTimeline *timeline);
+
 signals:
     void jumpToFile(const QString &file);
     // byteStart/byteEnd are absolute UTF-8 byte offsets; the receiver maps them
@@ -0,0 +1,134 @@
+// A stand-in for rg that replays a recorded `rg --json` transcript instead of
+// searching, so that load tests do not depend on the machine's rg or disk.
+// Point the plugin (or ripgrep_search_cli) at it with RIPGREP_SEARCH_RG. Its
+// arguments are ignored, so every rg process of a search replays the whole
+// transcript. It is configured through the environment:
+//
+//   FAKE_RG_TRANSCRIPT     file holding the output of `rg --json ...`
+//   FAKE_RG_REPEAT         replay it this many times, each copy under paths
+//                          prefixed with "copy<n>/" (default 1)
+//   FAKE_RG_RATE           messages per second, 0 for as fast as possible
+//   FAKE_RG_BURST          messages written at once (default 1)
+//   FAKE_RG_STALL_EVERY    stall after every this many messages...
+//   FAKE_RG_STALL_MS       ...for this long
+//   FAKE_RG_EXIT_DELAY_MS  linger this long after closing stdout
+//   FAKE_RG_FAIL           print this to stderr and exit 2 without output,
+//                          the way rg rejects an invalid pattern
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QThread>
+
+#include <cstdio>
+
+static int envInt(const char *name, int fallback)
+{
+    bool ok = false;
+    const int value = qEnvironmentVariableIntValue(name, &ok);
+    return ok ? value : fallback;
+}
+
+int main(int argc, char *argv[])
+{
+    // Like rg, read a buffer searched through stdin to its end.
+    for (int i = 1; i < argc; ++i) {
+        if (qstrcmp(argv[i], "-") == 0) {
+            QFile in;
+            if (in.open(stdin, QIODevice::ReadOnly))
+                in.readAll();
+        }
+    }
+
+    if (const auto failure = qgetenv("FAKE_RG_FAIL"); !failure.isEmpty()) {
+        std::fprintf(stderr, "%s\n", failure.constData());
+        return 2;
+    }
+
+    // The transcript's own summary is replaced by one that matches the replay.
+    QList<QByteArray> messages;
+    qint64 matches = 0;
+    qint64 matchMessages = 0;
+    bool summarized = false;
+    QFile transcript(qEnvironmentVariable("FAKE_RG_TRANSCRIPT"));
+    if (transcript.open(QIODevice::ReadOnly)) {
+        while (!transcript.atEnd()) {
+            auto line = transcript.readLine();
+            if (line.trimmed().isEmpty())
+                continue;
+            if (!line.endsWith('\n'))
+                line.append('\n');
+            if (line.contains("\"type\":\"summary\"")) {
+                const auto data = QJsonDocument::fromJson(line).object().value(QStringLiteral("data")).toObject();
+                matches += data.value(QStringLiteral("stats")).toObject().value(QStringLiteral("matches")).toInteger();
+                summarized = true;
+                continue;
+            }
+            if (line.contains("\"type\":\"match\""))
+                ++matchMessages;
+            messages.append(line);
+        }
+    }
+    if (!summarized)
+        matches = matchMessages;
+
+    const int repeat = qMax(1, envInt("FAKE_RG_REPEAT", 1));
+    const int rate = envInt("FAKE_RG_RATE", 0);
+    const int burst = qMax(1, envInt("FAKE_RG_BURST", 1));
+    const int stallEvery = envInt("FAKE_RG_STALL_EVERY", 0);
+    const int stallMs = envInt("FAKE_RG_STALL_MS", 0);
+    const int exitDelayMs = envInt("FAKE_RG_EXIT_DELAY_MS", 0);
+
+    QElapsedTimer timer;
+    timer.start();
+    QByteArray pending;
+    auto flush = [&pending] {
+        std::fwrite(pending.constData(), 1, pending.size(), stdout);
+        std::fflush(stdout);
+        pending.clear();
+    };
+
+    const QByteArray pathKey("\"path\":{\"text\":\"");
+    qint64 written = 0;
+    qint64 stalled = 0;
+    for (int copy = 0; copy < repeat; ++copy) {
+        const QByteArray prefix = copy == 0 ? QByteArray() : "copy" + QByteArray::number(copy) + '/';
+        for (const auto &message : std::as_const(messages)) {
+            pending += prefix.isEmpty() ? message : QByteArray(message).replace(pathKey, pathKey + prefix);
+            ++written;
+            if (written % burst == 0) {
+                flush();
+                if (rate > 0) {
+                    // Keep to the rate on average, not counting stalls, so
+                    // that a stall is not made up for by a burst after it.
+                    const qint64 due = written * 1000 / rate + stalled;
+                    if (const qint64 ahead = due - timer.elapsed(); ahead > 0)
+                        QThread::msleep(ahead);
+                }
+            }
+            if (stallEvery > 0 && written % stallEvery == 0) {
+                flush();
+                QThread::msleep(stallMs);
+                stalled += stallMs;
+            }
+        }
+    }
+
+    const QJsonObject summary{
+        {QStringLiteral("type"), QStringLiteral("summary")},
+        {QStringLiteral("data"),
+         QJsonObject{
+             {QStringLiteral("elapsed_total"), QJsonObject{{QStringLiteral("nanos"), timer.nsecsElapsed()}}},
+             {QStringLiteral("stats"), QJsonObject{{QStringLiteral("matches"), matches * repeat}}},
+         }},
+    };
+    pending += QJsonDocument(summary).toJson(QJsonDocument::Compact) + '\n';
+    flush();
+    std::fclose(stdout);
+
+    if (exitDelayMs > 0)
+        QThread::msleep(exitDelayMs);
+    return matches > 0 ? 0 : 1;
+}
@@ -0,0 +1,529 @@
+// Benchmarks of the search pipeline, from parsing ripgrep's output to painting
+// a result row, over generated corpora. Besides QtTest's own timings every
+// benchmark reports its throughput (MB/s) and/or cost per result, printed as a
+// table once all have run, so that regressions show up as plain numbers.
+//
+// The corpora are generated from a fixed seed: ripgrep's --json output is
+// produced for them here rather than by running rg, so nothing but the code
+// under test is measured.
+
+#include "LineIndex.hpp"
+#include "ResultStore.hpp"
+#include "RipgrepJsonParser.hpp"
+#include "SearchResultsModel.hpp"
+#include "SearchResultsView.hpp"
+
+#include <QAbstractItemDelegate>
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMap>
+#include <QPainter>
+#include <QRandomGenerator>
+#include <QStyleOptionViewItem>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <algorithm>
+
+enum class Corpus {
+    // Many files of a few KiB: the common source tree.
+    SmallFiles,
+    // A few files of many MiB, with ordinary lines.
+    HugeFiles,
+    // Files that are a single line of a MiB, like minified JavaScript.
+    Minified,
+    // CJK text, three UTF-8 bytes per character.
+    Multibyte,
+    // A million matches across a thousand files, without any file text.
+    Million,
+};
+Q_DECLARE_METATYPE(Corpus)
+
+struct GeneratedFile {
+    QString path;
+    QByteArray text;
+};
+
+// A match as RipgrepCommand::matchFound reports it.
+struct MatchRecord {
+    QString file;
+    QString text;
+    int line;
+    int start;
+    int end;
+    qint64 byteStart;
+    qint64 byteEnd;
+    bool firstInFile;
+};
+
+struct CorpusData {
+    QList<GeneratedFile> files;
+    // ripgrep's --json output for the files, one message per entry.
+    QList<QByteArray> messages;
+    qint64 messageBytes = 0;
+    QList<MatchRecord> records;
+};
+
+static QString corpusName(Corpus corpus)
+{
+    switch (corpus) {
+    case Corpus::SmallFiles:
+        return QStringLiteral("small-files");
+    case Corpus::HugeFiles:
+        return QStringLiteral("huge-files");
+    case Corpus::Minified:
+        return QStringLiteral("minified");
+    case Corpus::Multibyte:
+        return QStringLiteral("multibyte");
+    case Corpus::Million:
+        return QStringLiteral("million");
+    }
+    return QString();
+}
+
+static QByteArray needleFor(Corpus corpus)
+{
+    return corpus == Corpus::Multibyte ? QByteArray("検索") : QByteArray("needle");
+}
+
+static QByteArray generateText(Corpus corpus, qint64 size, QRandomGenerator &random)
+{
+    static const QList<QByteArray> asciiWords{"alpha", "beta", "gamma", "delta", "return", "static", "const", "value", "index", "buffer", "parser", "result"};
+    static const QList<QByteArray> cjkWords{"文字列", "結果", "行番号", "ファイル", "編集", "表示", "変換", "日本語", "中文", "한국어", "置換", "選択"};
+    const auto &words = corpus == Corpus::Multibyte ? cjkWords : asciiWords;
+    const bool minified = corpus == Corpus::Minified;
+    const QByteArray needle = needleFor(corpus);
+
+    QByteArray text;
+    text.reserve(size + 64);
+    int wordsLeft = 0;
+    while (text.size() < size) {
+        if (!minified && wordsLeft-- == 0) {
+            if (!text.isEmpty()) {
+                // Mostly "\n", some "\r\n" and the odd lone '\r', which only
+                // Kate counts as a line break.
+                const int kind = random.bounded(64);
+                text += kind == 0 ? "\r" : (kind < 8 ? "\r\n" : "\n");
+            }
+            if (random.bounded(4) == 0)
+                text += "    ";
+            wordsLeft = 6 + random.bounded(9);
+        }
+        text += random.bounded(40) == 0 ? needle : words.at(random.bounded(int(words.size())));
+        text += minified && random.bounded(8) == 0 ? ';' : ' ';
+    }
+    return text;
+}
+
+static QByteArray jsonMessage(const char *type, const QJsonObject &data)
+{
+    return QJsonDocument(QJsonObject{{"type", type}, {"data", data}}).toJson(QJsonDocument::Compact);
+}
+
+// What `rg --json needle` prints for a file: ripgrep breaks lines on '\n' only.
+static void ripgrepMessages(const QString &path, const QByteArray &text, const QByteArray &needle, QList<QByteArray> *messages)
+{
+    const QJsonObject pathObject{{"text", path}};
+    messages->append(jsonMessage("begin", {{"path", pathObject}}));
+    qint64 lineStart = 0;
+    int lineNumber = 1;
+    while (lineStart < text.size()) {
+        qint64 lineEnd = text.indexOf('\n', lineStart);
+        lineEnd = lineEnd < 0 ? text.size() : lineEnd + 1;
+        const QByteArray line = text.mid(lineStart, lineEnd - lineStart);
+        QJsonArray submatches;
+        for (qint64 at = line.indexOf(needle); at >= 0; at = line.indexOf(needle, at + needle.size()))
+            submatches.append(QJsonObject{{"match", QJsonObject{{"text", QString::fromUtf8(needle)}}}, {"start", at}, {"end", at + needle.size()}});
+        if (!submatches.isEmpty()) {
+            messages->append(jsonMessage("match",
+                                         {
+                                             {"path", pathObject},
+                                             {"lines", QJsonObject{{"text", QString::fromUtf8(line)}}},
+                                             {"line_number", lineNumber},
+                                             {"absolute_offset", lineStart},
+                                             {"submatches", submatches},
+                                         }));
+        }
+        lineStart = lineEnd;
+        ++lineNumber;
+    }
+    messages->append(jsonMessage("end", {{"path", pathObject}}));
+}
+
+static void fill(SearchResultsModel *model, const QList<MatchRecord> &records, int limit = -1)
+{
+    const qsizetype count = limit < 0 ? records.size() : std::min<qsizetype>(limit, records.size());
+    for (qsizetype i = 0; i < count; ++i) {
+        const auto &r = records.at(i);
+        if (r.firstInFile)
+            model->addMatchedFile(r.file);
+        model->addMatched(r.file, r.text, r.line, r.start, r.end, r.byteStart, r.byteEnd);
+    }
+}
+
+// Wall time across the iterations of a QBENCHMARK loop.
+struct Meter {
+    Meter()
+    {
+        timer.start();
+    }
+
+    QElapsedTimer timer;
+    qint64 runs = 0;
+};
+
+class RipgrepSearchBenchmark : public QObject
+{
+    Q_OBJECT
+private slots:
+    void parse_data();
+    void parse();
+    void insertResults_data();
+    void insertResults();
+    void checkedResults();
+    void lineStarts_data();
+    void lineStarts();
+    void mapToKate_data();
+    void mapToKate();
+    void paintDelegate_data();
+    void paintDelegate();
+    void cleanupTestCase();
+
+private:
+    const CorpusData &corpus(Corpus kind);
+    QString generatedFile(Corpus kind, qint64 megabytes);
+    void report(const Meter &meter, qint64 bytes, qint64 results, const QString &unit = QStringLiteral("result"));
+
+    QMap<Corpus, CorpusData> m_corpora;
+    QTemporaryDir m_dir;
+    QMap<QString, QString> m_report;
+};
+
+const CorpusData &RipgrepSearchBenchmark::corpus(Corpus kind)
+{
+    if (auto it = m_corpora.constFind(kind); it != m_corpora.constEnd())
+        return it.value();
+
+    CorpusData data;
+    QRandomGenerator random(1 + int(kind));
+    if (kind == Corpus::Million) {
+        QList<QString> lines;
+        for (int i = 0; i < 64; ++i)
+            lines.append(QString::fromUtf8(generateText(Corpus::Minified, 80, random)));
+        data.records.reserve(1000 * 1000);
+        for (int f = 0; f < 1000; ++f) {
+            const auto path = QStringLiteral("/corpus/million/dir%1/file%2.cpp").arg(f % 32).arg(f);
+            for (int m = 0; m < 1000; ++m) {
+                const int start = random.bounded(60);
+                data.records.append({path, lines.at(m % lines.size()), m + 1, start, start + 6, m * 96 + start, m * 96 + start + 6, m == 0});
+            }
+        }
+        return m_corpora.insert(kind, std::move(data)).value();
+    }
+
+    int files = 0;
+    qint64 fileSize = 0;
+    switch (kind) {
+    case Corpus::SmallFiles:
+        files = 20000;
+        fileSize = 2 << 10;
+        break;
+    case Corpus::HugeFiles:
+        files = 4;
+        fileSize = 16 << 20;
+        break;
+    case Corpus::Minified:
+        files = 32;
+        fileSize = 1 << 20;
+        break;
+    case Corpus::Multibyte:
+        files = 256;
+        fileSize = 128 << 10;
+        break;
+    case Corpus::Million:
+        break;
+    }
+
+    const auto needle = needleFor(kind);
+    for (int i = 0; i < files; ++i) {
+        GeneratedFile file{QStringLiteral("/corpus/%1/dir%2/file%3.txt").arg(corpusName(kind)).arg(i % 64).arg(i), generateText(kind, fileSize, random)};
+        ripgrepMessages(file.path, file.text, needle, &data.messages);
+        data.files.append(std::move(file));
+    }
+
+    RipgrepMessage message;
+    QString lastFile;
+    for (const auto &line : std::as_const(data.messages)) {
+        data.messageBytes += line.size();
+        if (!parseRipgrepMessage(line, &message) || message.type != RipgrepMessage::Match)
+            continue;
+        for (const auto &submatch : std::as_const(message.submatches)) {
+            data.records.append({message.path, message.text, message.line, submatch.start, submatch.end, submatch.byteStart, submatch.byteEnd, message.path != lastFile});
+            lastFile = message.path;
+        }
+    }
+    data.messages.append(jsonMessage("summary", {{"elapsed_total", QJsonObject{{"nanos", 0}}}, {"stats", QJsonObject{{"matches", data.records.size()}}}}));
+    return m_corpora.insert(kind, std::move(data)).value();
+}
+
+// A file of the given corpus on disk. One generated chunk is written over and
+// over; generating a gigabyte of random text would take far longer than
+// anything measured on it.
+QString RipgrepSearchBenchmark::generatedFile(Corpus kind, qint64 megabytes)
+{
+    const auto path = m_dir.filePath(QStringLiteral("%1-%2M.txt").arg(corpusName(kind)).arg(megabytes));
+    if (QFileInfo::exists(path))
+        return path;
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return QString();
+    QRandomGenerator random(1 + int(kind));
+    const QByteArray chunk = generateText(kind, 8 << 20, random);
+    for (qint64 written = 0; written < megabytes << 20; written += chunk.size())
+        file.write(chunk);
+    return path;
+}
+
+void RipgrepSearchBenchmark::report(const Meter &meter, qint64 bytes, qint64 results, const QString &unit)
+{
+    if (meter.runs == 0)
+        return;
+    const double nanos = double(meter.timer.nsecsElapsed()) / meter.runs;
+    QStringList parts;
+    if (bytes > 0)
+        parts.append(QStringLiteral("%1 MB/s").arg(bytes / nanos * 1e3, 0, 'f', 1));
+    if (results > 0)
+        parts.append(QStringLiteral("%1 ns/%2 (%3 %2s)").arg(nanos / results, 0, 'f', 1).arg(unit).arg(results));
+    // QtTest may run a benchmark several times before it accepts the timing;
+    // the last run is the one reported.
+    const auto key = QStringLiteral("%1(%2)").arg(QString::fromLatin1(QTest::currentTestFunction()), QString::fromUtf8(QTest::currentDataTag()));
+    m_report.insert(key, parts.join(QStringLiteral(", ")));
+}
+
+void RipgrepSearchBenchmark::cleanupTestCase()
+{
+    for (auto it = m_report.cbegin(); it != m_report.cend(); ++it)
+        qInfo().noquote() << QStringLiteral("%1  %2").arg(it.key(), -40).arg(it.value());
+}
+
+void RipgrepSearchBenchmark::parse_data()
+{
+    QTest::addColumn<Corpus>("corpus");
+    for (auto kind : {Corpus::SmallFiles, Corpus::HugeFiles, Corpus::Minified, Corpus::Multibyte})
+        QTest::newRow(qPrintable(corpusName(kind))) << kind;
+}
+
+void RipgrepSearchBenchmark::parse()
+{
+    QFETCH(Corpus, corpus);
+    const auto &data = this->corpus(corpus);
+
+    RipgrepMessage message;
+    qint64 results = 0;
+    Meter meter;
+    QBENCHMARK {
+        results = 0;
+        for (const auto &line : data.messages) {
+            parseRipgrepMessage(line, &message);
+            results += message.submatches.size();
+        }
+        ++meter.runs;
+    }
+    report(meter, data.messageBytes, results);
+}
+
+void RipgrepSearchBenchmark::insertResults_data()
+{
+    QTest::addColumn<Corpus>("corpus");
+    for (auto kind : {Corpus::SmallFiles, Corpus::Minified, Corpus::Million})
+        QTest::newRow(qPrintable(corpusName(kind))) << kind;
+}
+
+void RipgrepSearchBenchmark::insertResults()
+{
+    QFETCH(Corpus, corpus);
+    const auto &data = this->corpus(corpus);
+
+    SearchResultsModel model;
+    Meter meter;
+    // Each run starts by dropping the previous run's rows, which is part of
+    // what a new search costs too.
+    QBENCHMARK {
+        model.clear();
+        fill(&model, data.records);
+        ++meter.runs;
+    }
+    QCOMPARE(qsizetype(model.store()->matchCount()), data.records.size());
+    report(meter, 0, data.records.size());
+}
+
+void RipgrepSearchBenchmark::checkedResults()
+{
+    const auto &data = corpus(Corpus::Million);
+    SearchResultsModel model;
+    fill(&model, data.records);
+    // Leave some gaps, as a selection being edited would.
+    for (int i = 0; i < model.rowCount(); i += 3)
+        model.setData(model.index(0, 0, model.index(i, 0)), Qt::Unchecked, Qt::CheckStateRole);
+
+    qsizetype results = 0;
+    Meter meter;
+    QBENCHMARK {
+        results = model.checkedResults().size();
+        ++meter.runs;
+    }
+    report(meter, 0, results);
+}
+
+void RipgrepSearchBenchmark::lineStarts_data()
+{
+    const int hugeMegabytes = qEnvironmentVariableIsSet("RIPGREP_BENCH_HUGE_MB") ? qEnvironmentVariableIntValue("RIPGREP_BENCH_HUGE_MB") : 1024;
+    QTest::addColumn<Corpus>("corpus");
+    QTest::addColumn<qint64>("megabytes");
+    QTest::newRow("huge-files") << Corpus::HugeFiles << qint64(hugeMegabytes);
+    QTest::newRow("minified") << Corpus::Minified << qint64(64);
+    QTest::newRow("multibyte") << Corpus::Multibyte << qint64(256);
+}
+
+void RipgrepSearchBenchmark::lineStarts()
+{
+    QFETCH(Corpus, corpus);
+    QFETCH(qint64, megabytes);
+    const auto path = generatedFile(corpus, megabytes);
+    QVERIFY(!path.isEmpty());
+
+    qsizetype lines = 0;
+    Meter meter;
+    QBENCHMARK {
+        LineIndexCache cache;
+        lines = cache.lineStarts(path).size();
+        ++meter.runs;
+    }
+    report(meter, QFileInfo(path).size(), lines, QStringLiteral("line"));
+}
+
+void RipgrepSearchBenchmark::mapToKate_data()
+{
+    QTest::addColumn<Corpus>("corpus");
+    QTest::newRow("ascii") << Corpus::SmallFiles;
+    QTest::newRow("cjk") << Corpus::Multibyte;
+}
+
+// The document-independent part of jumping to a result: finding the Kate line
+// of both ends through the line-start index and turning their byte offsets
+// into columns of the line's text.
+void RipgrepSearchBenchmark::mapToKate()
+{
+    QFETCH(Corpus, corpus);
+    const auto &data = this->corpus(corpus);
+
+    struct FileLines {
+        QList<qint64> starts;
+        QStringList lines;
+    };
+    QHash<QString, FileLines> files;
+    for (const auto &file : data.files) {
+        FileLines lines{lineStartsOf(file.text), {}};
+        for (int i = 0; i < lines.starts.size(); ++i) {
+            const qint64 end = i + 1 < lines.starts.size() ? lines.starts.at(i + 1) : file.text.size();
+            auto line = QString::fromUtf8(file.text.mid(lines.starts.at(i), end - lines.starts.at(i)));
+            while (line.endsWith(QLatin1Char('\n')) || line.endsWith(QLatin1Char('\r')))
+                line.chop(1);
+            lines.lines.append(line);
+        }
+        files.insert(file.path, std::move(lines));
+    }
+    QList<const FileLines *> fileOf;
+    fileOf.reserve(data.records.size());
+    for (const auto &r : data.records)
+        fileOf.append(&files[r.file]);
+
+    qint64 columns = 0;
+    Meter meter;
+    QBENCHMARK {
+        columns = 0;
+        for (qsizetype i = 0; i < data.records.size(); ++i) {
+            const auto &r = data.records.at(i);
+            const auto file = fileOf.at(i);
+            const int startLine = lineAtOffset(file->starts, r.byteStart);
+            const int endLine = std::max(startLine, lineAtOffset(file->starts, r.byteEnd));
+            columns += columnAtByte(file->lines.at(startLine), r.byteStart - file->starts.at(startLine));
+            columns += columnAtByte(file->lines.at(endLine), r.byteEnd - file->starts.at(endLine));
+        }
+        ++meter.runs;
+    }
+    QVERIFY(columns > 0);
+    report(meter, 0, data.records.size());
+}
+
+void RipgrepSearchBenchmark::paintDelegate_data()
+{
+    QTest::addColumn<Corpus>("corpus");
+    QTest::addColumn<int>("results");
+    QTest::addColumn<bool>("checkboxes");
+    QTest::newRow("small-files") << Corpus::SmallFiles << 20000 << false;
+    QTest::newRow("small-files, checkboxes") << Corpus::SmallFiles << 20000 << true;
+    QTest::newRow("multibyte") << Corpus::Multibyte << 20000 << false;
+    // Every row is a MiB long line.
+    QTest::newRow("minified") << Corpus::Minified << 100 << false;
+}
+
+// Paints rows through the results view's delegate onto an image; run with the
+// offscreen platform (the default here) no display is needed.
+void RipgrepSearchBenchmark::paintDelegate()
+{
+    QFETCH(Corpus, corpus);
+    QFETCH(int, results);
+    QFETCH(bool, checkboxes);
+    const auto &data = this->corpus(corpus);
+
+    SearchResultsModel model;
+    fill(&model, data.records, results);
+    SearchResultsView view(&model);
+    view.setShowCheckboxes(checkboxes);
+    view.resize(800, 600);
+
+    QModelIndexList indexes;
+    for (int i = 0; i < model.rowCount(); ++i) {
+        const auto file = model.index(i, 0);
+        indexes.append(file);
+        for (int j = 0; j < model.rowCount(file); ++j)
+            indexes.append(model.index(j, 0, file));
+    }
+
+    QStyleOptionViewItem option;
+    option.initFrom(&view);
+    option.widget = &view;
+    option.font = view.font();
+    option.rect = QRect(0, 0, 800, view.fontMetrics().height() + 4);
+    QImage image(option.rect.size(), QImage::Format_ARGB32_Premultiplied);
+    QPainter painter(&image);
+    auto delegate = view.itemDelegate();
+
+    Meter meter;
+    QBENCHMARK {
+        for (const auto &index : std::as_const(indexes))
+            delegate->paint(&painter, option, index);
+        ++meter.runs;
+    }
+    report(meter, 0, indexes.size(), QStringLiteral("row"));
+}
+
+int main(int argc, char *argv[])
+{
+    // Paint without a display unless a platform was asked for.
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    RipgrepSearchBenchmark benchmark;
+    return QTest::qExec(&benchmark, argc, argv);
+}
+
+#include "RipgrepSearchBenchmark.moc"
@@ -0,0 +1,168 @@
+// Runs a search through the same core the plugin uses, without any GUI, and
+// reports what it found and how long each stage took. Meant for profiling the
+// search pipeline and for scripting; see --help.
+
+#include "ResultExporter.hpp"
+#include "ResultStore.hpp"
+#include "RipgrepCommand.hpp"
+#include "SearchTimeline.hpp"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QFile>
+#include <QFileInfo>
+#include <QScopedPointer>
+#include <QTextStream>
+
+#include <algorithm>
+
+static void printResults(const ResultStore &store, QTextStream &out)
+{
+    for (auto file : std::as_const(store.root()->children)) {
+        for (auto match : std::as_const(file->children)) {
+            for (auto context : std::as_const(match->children)) {
+                if (context->line >= match->line)
+                    break;
+                if (auto line = store.contextLine(context))
+                    out << file->file << '-' << context->line << '-' << line->text.trimmed() << '\n';
+            }
+            out << file->file << ':' << match->line << ':' << match->start + 1 << ':' << store.matchText(match).trimmed() << '\n';
+            for (auto context : std::as_const(match->children)) {
+                if (context->line <= match->line)
+                    continue;
+                if (auto line = store.contextLine(context))
+                    out << file->file << '-' << context->line << '-' << line->text.trimmed() << '\n';
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(QStringLiteral("ripgrep_search_cli"));
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QStringLiteral("Search with the ripgrep search plugin's core and time it."));
+    parser.addHelpOption();
+    QCommandLineOption regexOption(QStringLiteral("regex"), QStringLiteral("Treat the pattern as a regular expression."));
+    QCommandLineOption wordOption(QStringLiteral("word"), QStringLiteral("Match whole words only."));
+    QCommandLineOption caseOption(QStringLiteral("case"), QStringLiteral("Match case."));
+    QCommandLineOption multilineOption(QStringLiteral("multiline"), QStringLiteral("Let matches span lines."));
+    QCommandLineOption contextOption(QStringList{QStringLiteral("C"), QStringLiteral("context")},
+                                     QStringLiteral("Show <lines> lines of context around each match."),
+                                     QStringLiteral("lines"),
+                                     QStringLiteral("0"));
+    QCommandLineOption quietOption(QStringList{QStringLiteral("q"), QStringLiteral("quiet")}, QStringLiteral("Print the timings only."));
+    QCommandLineOption programOption(QStringLiteral("rg"),
+                                     QStringLiteral("The ripgrep executable to run (default: $RIPGREP_SEARCH_RG, or rg)."),
+                                     QStringLiteral("program"),
+                                     RipgrepCommand::defaultProgram());
+    QCommandLineOption traceOption(QStringLiteral("trace"), QStringLiteral("Write the search's timeline to <file> as a Chrome trace."), QStringLiteral("file"));
+    QCommandLineOption exportOption(QStringLiteral("export"),
+                                    QStringLiteral("Stream the matches to <file> instead of keeping and printing them: as JSON Lines or SARIF "
+                                                   "if its name ends in .jsonl or .sarif, grep style otherwise."),
+                                    QStringLiteral("file"));
+    parser.addOptions({regexOption, wordOption, caseOption, multilineOption, contextOption, quietOption, programOption, traceOption, exportOption});
+    parser.addPositionalArgument(QStringLiteral("pattern"), QStringLiteral("What to search for."));
+    parser.addPositionalArgument(QStringLiteral("paths"), QStringLiteral("Directories, or files, to search (default: the current directory)."), QStringLiteral("[paths...]"));
+    parser.process(app);
+
+    auto args = parser.positionalArguments();
+    if (args.isEmpty())
+        parser.showHelp(1);
+    const auto pattern = args.takeFirst();
+    const int context = parser.value(contextOption).toInt();
+
+    RipgrepCommand rg(nullptr);
+    ResultStore store;
+    rg.setProgram(parser.value(programOption));
+    rg.setUseRegex(parser.isSet(regexOption));
+    rg.setWholeWord(parser.isSet(wordOption));
+    rg.setCaseSensitive(parser.isSet(caseOption));
+    rg.setMultiline(parser.isSet(multilineOption));
+    rg.setContextLines(context, context);
+    store.setContextLines(context, context);
+
+    QScopedPointer<ResultExporter> exporter;
+    if (parser.isSet(exportOption)) {
+        const auto path = parser.value(exportOption);
+        exporter.reset(new ResultExporter(path, ResultExporter::formatForPath(path)));
+    }
+
+    auto timeline = rg.timeline();
+    QObject::connect(&rg, &RipgrepCommand::matchFoundInFile, &app, [&](const QString &file) {
+        if (exporter)
+            return;
+        SearchTimeline::Scope scope(timeline, SearchTimeline::Insert);
+        store.addFile(file);
+    });
+    QObject::connect(&rg, &RipgrepCommand::matchFound, &app, [&](const QString &file, const QString &text, int line, int start, int end, qint64 byteStart, qint64 byteEnd) {
+        SearchTimeline::Scope scope(timeline, SearchTimeline::Insert);
+        if (exporter) {
+            exporter->addMatch(file, text, line, start, end, byteStart, byteEnd);
+            return;
+        }
+        store.addMatch(file, text, line, start, end, byteStart, byteEnd);
+        timeline->updateMemory(store.memoryUsage());
+    });
+    QObject::connect(&rg, &RipgrepCommand::contextFound, &app, [&](const QString &file, const QString &text, int line, qint64 byteOffset) {
+        if (exporter)
+            return;
+        SearchTimeline::Scope scope(timeline, SearchTimeline::Insert);
+        store.addContext(file, text, line, byteOffset);
+        timeline->updateMemory(store.memoryUsage());
+    });
+    QObject::connect(&rg, &RipgrepCommand::searchFailed, &app, [](const QString &message) {
+        QTextStream(stderr) << message << '\n';
+        QCoreApplication::exit(2);
+    });
+    QObject::connect(&rg, &RipgrepCommand::searchFinished, &app, [&](int found) {
+        QTextStream err(stderr);
+        if (exporter) {
+            err << "Matches: " << found << '\n';
+        } else {
+            QTextStream out(stdout);
+            if (!parser.isSet(quietOption))
+                printResults(store, out);
+            err << "Files: " << store.fileCount() << '\n';
+            err << "Matches: " << store.matchCount() << " (rg reported " << found << ")\n";
+        }
+        err << timeline->summary() << '\n';
+        if (parser.isSet(traceOption)) {
+            QFile trace(parser.value(traceOption));
+            if (!trace.open(QIODevice::WriteOnly) || trace.write(timeline->toChromeTrace()) < 0)
+                err << "Could not write " << trace.fileName() << ": " << trace.errorString() << '\n';
+        }
+        if (!exporter) {
+            QCoreApplication::exit(found > 0 ? 0 : 1);
+            return;
+        }
+        // Exit once the export has been written out.
+        QObject::connect(exporter.data(), &ResultExporter::finished, &app, [found](qint64 count, qint64 skipped, const QString &error) {
+            QTextStream err(stderr);
+            if (!error.isEmpty()) {
+                err << "Could not export: " << error << '\n';
+                QCoreApplication::exit(2);
+                return;
+            }
+            err << "Exported: " << count << '\n';
+            if (skipped > 0)
+                err << "Skipped (changed since the search): " << skipped << '\n';
+            QCoreApplication::exit(found > 0 ? 0 : 1);
+        });
+        exporter->finish();
+    });
+
+    const bool dirs = !args.isEmpty() && std::all_of(args.cbegin(), args.cend(), [](const QString &arg) {
+        return QFileInfo(arg).isDir();
+    });
+    if (dirs)
+        rg.searchInDirs(pattern, args);
+    else if (args.isEmpty())
+        rg.searchInDir(pattern, QStringLiteral("."));
+    else
+        rg.searchInFiles(pattern, args);
+
+    return app.exec();
+}
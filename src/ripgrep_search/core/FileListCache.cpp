@@ -0,0 +1,613 @@
+#include "FileListCache.hpp"
+#include "FileWatchManager.hpp"
+#include "GlobFilter.hpp"
+#include "RipgrepCommand.hpp"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QHash>
+#include <QPointer>
+#include <QProcess>
+#include <QSet>
+#include <QTimer>
+
+#include <algorithm>
+#include <vector>
+
+// Directories the watch manager has no watch for are polled this often.
+static constexpr int pollInterval = 5000;
+// Changes come in bursts (a checkout, a build); the directories a burst
+// touched are listed again once it is over.
+static constexpr int settleInterval = 300;
+// What a match in the file name is worth over one that needs its directories.
+static constexpr int nameBonus = 50;
+
+// One rg process: the files of dirs (relative to the root, empty for the root
+// itself) and below, or only those right in them.
+struct FileListing {
+    QStringList dirs;
+    bool shallow = false;
+};
+
+// The files as match() reads them: every path lower-cased, back to back in one
+// string, and the character masks in an array of their own.
+struct FileListIndex {
+    QStringList paths;
+    QString lowered;
+    std::vector<int> offsets;
+    std::vector<int> nameStarts;
+    std::vector<quint64> masks;
+};
+
+static QString parentOf(const QString &path)
+{
+    const int slash = path.lastIndexOf(QLatin1Char('/'));
+    return slash < 0 ? QString() : path.left(slash);
+}
+
+static QString childOf(const QString &dir, const QString &name)
+{
+    return dir.isEmpty() ? name : dir + QLatin1Char('/') + name;
+}
+
+static bool isBelow(const QString &path, const QString &dir)
+{
+    if (dir.isEmpty())
+        return !path.isEmpty();
+    return path.size() > dir.size() && path.startsWith(dir) && path.at(dir.size()) == QLatin1Char('/');
+}
+
+static qint64 modifiedOf(const QString &dir)
+{
+    return QFileInfo(dir).lastModified().toMSecsSinceEpoch();
+}
+
+// A bit per letter and digit; everything else shares the bits left. The masks
+// only rule paths out, so two characters on one bit merely cost a scoring.
+static quint64 characterBit(char16_t c)
+{
+    if (c >= u'a' && c <= u'z')
+        return quint64(1) << (c - u'a');
+    if (c >= u'0' && c <= u'9')
+        return quint64(1) << (26 + c - u'0');
+    return quint64(1) << (36 + c % 28);
+}
+
+static bool isWordSeparator(QChar c)
+{
+    return c == QLatin1Char('/') || c == QLatin1Char('_') || c == QLatin1Char('-') || c == QLatin1Char('.') || c == QLatin1Char(' ');
+}
+
+// Scores the characters of pattern (lower-cased) in text from from on, taking
+// each at its first place after the one before, or returns -1 if they are not
+// all there. A character scores more at the start of a word and right after
+// the one before, and less the more it had to skip to get there.
+static int scoreFrom(const QChar *text, const QChar *lowered, int from, int length, const QString &pattern)
+{
+    int score = 0;
+    int previous = -1;
+    int next = 0;
+    for (int i = from; i < length && next < pattern.size(); ++i) {
+        if (lowered[i] != pattern.at(next))
+            continue;
+        score += 1;
+        if (i == 0 || isWordSeparator(text[i - 1]) || (text[i].isUpper() && text[i - 1].isLower()))
+            score += 8;
+        if (previous >= 0 && i == previous + 1)
+            score += 5;
+        else if (previous >= 0)
+            score -= std::min(i - previous - 1, 3);
+        previous = i;
+        ++next;
+    }
+    return next == pattern.size() ? score : -1;
+}
+
+struct FileListCachePrivate {
+    void reset();
+    void listDirectories();
+    void startNext();
+    void drain();
+    void finish();
+    void stop();
+    void apply(const FileListing &listing, const QStringList &listed);
+    void addFile(const QString &file);
+    void addDirectory(const QString &dir);
+    void removeTree(const QString &dir, bool withDir = true);
+    void unwatch(const QString &dir);
+    void unwatchAll();
+    void directoryChanged(const QString &dir);
+    void updateIndex();
+    QString absolute(const QString &dir) const;
+
+    FileListCache *q;
+    QString root;
+    QProcess *process = nullptr;
+    FileListing listing;
+    QStringList listed;
+    QList<FileListing> queue;
+    QElapsedTimer timer;
+    bool ready = false;
+    // Relative to the root, with '/' separators.
+    QSet<QString> files;
+    // The directories with listed files in or below them, the root ("")
+    // included; these are watched or polled.
+    QSet<QString> directories;
+    // The directories seen without any (ignored ones, or empty ones), so that
+    // they are not taken for new ones every time their parent changes.
+    QSet<QString> otherDirectories;
+    // Shared with the results and the other lists; it may go first when the
+    // engine does.
+    QPointer<FileWatchManager> watcher;
+    int watched = 0;
+    QHash<QString, qint64> polled;
+    QTimer *pollTimer = nullptr;
+    QTimer *settleTimer = nullptr;
+    QSet<QString> changed;
+    // Rebuilt from files when a match needs it after they changed.
+    FileListIndex index;
+    bool indexStale = true;
+    // The last pattern matched (as scored) and what matched it, by index.
+    QString lastPattern;
+    std::vector<int> lastMatches;
+    // The filter last matched with, and what it said of each file by index:
+    // 0 when not asked yet, 1 when it lets the file through, -1 when not.
+    GlobFilter lastFilter;
+    std::vector<qint8> verdicts;
+};
+
+FileListCache::FileListCache(const QString &root, FileWatchManager *watcher, QObject *parent)
+    : QObject(parent)
+    , d(new FileListCachePrivate)
+{
+    d->q = this;
+    d->root = QDir(root).absolutePath();
+
+    d->watcher = watcher;
+    connect(watcher, &FileWatchManager::directoryChanged, this, [this](const QString &dir) {
+        // Every list hears of every directory.
+        if (dir == d->root || (dir.startsWith(d->root) && dir.at(d->root.size()) == QLatin1Char('/')))
+            d->directoryChanged(QDir(d->root).relativeFilePath(dir));
+    });
+    d->pollTimer = new QTimer(this);
+    d->pollTimer->setInterval(pollInterval);
+    connect(d->pollTimer, &QTimer::timeout, this, [this] {
+        for (auto it = d->polled.begin(); it != d->polled.end(); ++it) {
+            const qint64 modified = modifiedOf(d->absolute(it.key()));
+            if (modified == it.value())
+                continue;
+            it.value() = modified;
+            d->directoryChanged(it.key());
+        }
+    });
+    d->settleTimer = new QTimer(this);
+    d->settleTimer->setSingleShot(true);
+    d->settleTimer->setInterval(settleInterval);
+    connect(d->settleTimer, &QTimer::timeout, this, [this] {
+        d->listDirectories();
+    });
+}
+
+FileListCache::~FileListCache()
+{
+    d->stop();
+    d->unwatchAll();
+}
+
+QString FileListCache::root() const
+{
+    return d->root;
+}
+
+bool FileListCache::isReady() const
+{
+    return d->ready;
+}
+
+int FileListCache::count() const
+{
+    return d->files.size();
+}
+
+QString FileListCachePrivate::absolute(const QString &dir) const
+{
+    return dir.isEmpty() ? root : root + QLatin1Char('/') + dir;
+}
+
+void FileListCache::refresh()
+{
+    d->reset();
+    d->queue.append({{QString()}, false});
+    d->startNext();
+}
+
+void FileListCachePrivate::reset()
+{
+    stop();
+    ready = false;
+    queue.clear();
+    changed.clear();
+    settleTimer->stop();
+    pollTimer->stop();
+    unwatchAll();
+    files.clear();
+    directories.clear();
+    otherDirectories.clear();
+    indexStale = true;
+    addDirectory(QString());
+}
+
+void FileListCachePrivate::stop()
+{
+    if (!process)
+        return;
+    // A superseded listing must not be applied.
+    QObject::disconnect(process, nullptr, q, nullptr);
+    if (process->state() != QProcess::NotRunning) {
+        process->kill();
+        process->waitForFinished();
+    }
+    process->deleteLater();
+    process = nullptr;
+}
+
+void FileListCachePrivate::startNext()
+{
+    if (process || queue.isEmpty())
+        return;
+    listing = queue.takeFirst();
+    listed.clear();
+
+    QStringList args{QStringLiteral("--files")};
+    if (listing.shallow)
+        args << "--max-depth" << "1";
+    args << "--";
+    for (const auto &dir : std::as_const(listing.dirs))
+        args << (dir.isEmpty() ? QStringLiteral(".") : dir);
+
+    // Run from the root, so that the paths come out relative to it.
+    process = new QProcess(q);
+    process->setWorkingDirectory(root);
+    q->connect(process, &QProcess::readyReadStandardOutput, q, [this] {
+        drain();
+    });
+    q->connect(process, &QProcess::finished, q, [this] {
+        finish();
+    });
+    q->connect(process, &QProcess::errorOccurred, q, [this](QProcess::ProcessError error) {
+        if (error != QProcess::FailedToStart)
+            return;
+        const auto message = process->errorString();
+        stop();
+        queue.clear();
+        emit q->failed(message);
+    });
+    timer.start();
+    process->start(RipgrepCommand::defaultProgram(), args, QIODevice::ReadOnly);
+}
+
+void FileListCachePrivate::drain()
+{
+    while (process->canReadLine()) {
+        auto line = QString::fromUtf8(process->readLine());
+        if (line.endsWith(QLatin1Char('\n')))
+            line.chop(1);
+        line = QDir::fromNativeSeparators(line);
+        if (line.startsWith(QLatin1String("./")))
+            line.remove(0, 2);
+        if (!line.isEmpty())
+            listed.append(line);
+    }
+}
+
+void FileListCachePrivate::finish()
+{
+    drain();
+    // rg exits with 1 when there are no files and 2 when some could not be
+    // read; either way what it listed is what there is.
+    const auto errors = QString::fromUtf8(process->readAllStandardError()).trimmed();
+    if (!errors.isEmpty())
+        qWarning() << "[ripgrep] Listing files:" << errors;
+    process->deleteLater();
+    process = nullptr;
+
+    apply(listing, listed);
+    listed.clear();
+    if (listing.dirs == QStringList{QString()} && !listing.shallow) {
+        ready = true;
+        qInfo() << "[ripgrep] Listed" << files.size() << "files in" << root << "in" << timer.elapsed() << "ms," << watched << "directories watched,"
+                << polled.size() << "polled";
+    } else {
+        qInfo() << "[ripgrep] Listed" << listing.dirs.size() << "changed directories again in" << timer.elapsed() << "ms";
+    }
+    startNext();
+    if (!process)
+        emit q->updated();
+}
+
+// Takes what a listing found in place of what was known of its directories.
+void FileListCachePrivate::apply(const FileListing &listing, const QStringList &listed)
+{
+    if (listing.shallow) {
+        const QSet<QString> dirs(listing.dirs.begin(), listing.dirs.end());
+        for (auto it = files.begin(); it != files.end();) {
+            if (dirs.contains(parentOf(*it)))
+                it = files.erase(it);
+            else
+                ++it;
+        }
+    } else {
+        for (const auto &dir : listing.dirs) {
+            if (!directories.contains(dir))
+                continue;
+            // The directory itself stays known, as what was listed is below it.
+            removeTree(dir, false);
+        }
+    }
+    for (const auto &file : listed)
+        addFile(file);
+    if (!listing.shallow) {
+        for (const auto &dir : listing.dirs) {
+            const auto names = QDir(absolute(dir)).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+            for (const auto &name : names) {
+                const auto subdir = childOf(dir, name);
+                if (!directories.contains(subdir))
+                    otherDirectories.insert(subdir);
+            }
+        }
+    }
+    indexStale = true;
+}
+
+void FileListCachePrivate::addFile(const QString &file)
+{
+    files.insert(file);
+    addDirectory(parentOf(file));
+}
+
+// Watches dir and the directories above it, up to the first one already known.
+void FileListCachePrivate::addDirectory(const QString &dir)
+{
+    if (directories.contains(dir))
+        return;
+    directories.insert(dir);
+    otherDirectories.remove(dir);
+    const auto path = absolute(dir);
+    if (watcher && watcher->watchDirectory(path)) {
+        ++watched;
+    } else {
+        polled.insert(dir, modifiedOf(path));
+        if (!pollTimer->isActive())
+            pollTimer->start();
+    }
+    if (!dir.isEmpty())
+        addDirectory(parentOf(dir));
+}
+
+// Forgets everything below dir, and dir itself unless told otherwise.
+void FileListCachePrivate::removeTree(const QString &dir, bool withDir)
+{
+    for (auto it = files.begin(); it != files.end();) {
+        if (isBelow(*it, dir))
+            it = files.erase(it);
+        else
+            ++it;
+    }
+    for (auto it = directories.begin(); it != directories.end();) {
+        if ((withDir && *it == dir) || isBelow(*it, dir)) {
+            unwatch(*it);
+            it = directories.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = otherDirectories.begin(); it != otherDirectories.end();) {
+        if ((withDir && *it == dir) || isBelow(*it, dir))
+            it = otherDirectories.erase(it);
+        else
+            ++it;
+    }
+    indexStale = true;
+}
+
+void FileListCachePrivate::unwatch(const QString &dir)
+{
+    if (polled.remove(dir) > 0)
+        return;
+    --watched;
+    if (watcher)
+        watcher->unwatchDirectory(absolute(dir));
+}
+
+// Gives back the watches of all the directories.
+void FileListCachePrivate::unwatchAll()
+{
+    for (const auto &dir : std::as_const(directories)) {
+        if (!polled.contains(dir) && watcher)
+            watcher->unwatchDirectory(absolute(dir));
+    }
+    watched = 0;
+    polled.clear();
+}
+
+void FileListCachePrivate::directoryChanged(const QString &dir)
+{
+    // Nothing is known yet that could be out of date.
+    if (!ready)
+        return;
+    changed.insert(dir == QLatin1String(".") ? QString() : dir);
+    settleTimer->start();
+}
+
+// Lists the directories that changed again: only their own files, unless
+// there are directories in them that were not there before, which are listed
+// from the changed directory down so that their ignore files are applied.
+void FileListCachePrivate::listDirectories()
+{
+    QStringList shallow;
+    QStringList deep;
+    bool removed = false;
+    for (const auto &dir : std::as_const(changed)) {
+        if (!directories.contains(dir))
+            continue;
+        if (!QFileInfo(absolute(dir)).isDir()) {
+            // Its parent changed too, and is listed if need be.
+            removeTree(dir);
+            removed = true;
+            continue;
+        }
+        QSet<QString> subdirs;
+        for (const auto &name : QDir(absolute(dir)).entryList(QDir::Dirs | QDir::NoDotAndDotDot))
+            subdirs.insert(childOf(dir, name));
+        QStringList gone;
+        for (const auto &known : std::as_const(directories)) {
+            if (parentOf(known) == dir && !known.isEmpty() && !subdirs.contains(known))
+                gone.append(known);
+        }
+        for (const auto &known : std::as_const(otherDirectories)) {
+            if (parentOf(known) == dir && !subdirs.contains(known))
+                gone.append(known);
+        }
+        for (const auto &subdir : std::as_const(gone))
+            removeTree(subdir);
+        removed = removed || !gone.isEmpty();
+        const bool added = std::any_of(subdirs.begin(), subdirs.end(), [this](const QString &subdir) {
+            return !directories.contains(subdir) && !otherDirectories.contains(subdir);
+        });
+        (added ? deep : shallow).append(dir);
+    }
+    changed.clear();
+
+    if (!shallow.isEmpty())
+        queue.append({shallow, true});
+    if (!deep.isEmpty())
+        queue.append({deep, false});
+    startNext();
+    if (removed && !process)
+        emit q->updated();
+}
+
+void FileListCachePrivate::updateIndex()
+{
+    if (!indexStale)
+        return;
+    indexStale = false;
+    lastPattern.clear();
+    lastMatches.clear();
+    verdicts.assign(files.size(), 0);
+
+    index.paths = QStringList(files.begin(), files.end());
+    std::sort(index.paths.begin(), index.paths.end());
+    const int count = index.paths.size();
+    index.lowered.clear();
+    index.offsets.assign(1, 0);
+    index.offsets.reserve(count + 1);
+    index.nameStarts.clear();
+    index.nameStarts.reserve(count);
+    index.masks.clear();
+    index.masks.reserve(count);
+    for (const auto &path : std::as_const(index.paths)) {
+        quint64 mask = 0;
+        // Character by character, so that positions in the lowered copy are
+        // those in the path.
+        for (const QChar c : path) {
+            const QChar lower = c.toLower();
+            index.lowered.append(lower);
+            mask |= characterBit(lower.unicode());
+        }
+        index.offsets.push_back(index.lowered.size());
+        index.nameStarts.push_back(path.lastIndexOf(QLatin1Char('/')) + 1);
+        index.masks.push_back(mask);
+    }
+}
+
+QList<FileListCache::Match> FileListCache::match(const QString &pattern, const GlobFilter &filter, int limit, int *total) const
+{
+    d->updateIndex();
+    const auto &index = d->index;
+    if (filter != d->lastFilter) {
+        // What matched the last pattern may not be all a longer one can match.
+        d->lastFilter = filter;
+        d->lastPattern.clear();
+        d->lastMatches.clear();
+        d->verdicts.assign(index.paths.size(), 0);
+    }
+    auto allowed = [this, &filter, &index](int i) {
+        if (filter.isEmpty())
+            return true;
+        auto &verdict = d->verdicts[i];
+        if (verdict == 0)
+            verdict = filter.matches(index.paths.at(i)) ? 1 : -1;
+        return verdict > 0;
+    };
+
+    QString needle;
+    quint64 needed = 0;
+    for (const QChar c : pattern) {
+        if (c.isSpace())
+            continue;
+        needle.append(c.toLower());
+        needed |= characterBit(needle.back().unicode());
+    }
+    if (total)
+        *total = 0;
+    if (needle.isEmpty())
+        return {};
+
+    // Only what matched the shorter pattern can match a longer one.
+    std::vector<int> candidates;
+    if (!d->lastPattern.isEmpty() && needle.startsWith(d->lastPattern)) {
+        for (int i : d->lastMatches) {
+            if ((index.masks[i] & needed) == needed)
+                candidates.push_back(i);
+        }
+    } else {
+        const int count = index.masks.size();
+        for (int i = 0; i < count; ++i) {
+            if ((index.masks[i] & needed) == needed && allowed(i))
+                candidates.push_back(i);
+        }
+    }
+
+    std::vector<std::pair<int, int>> scored;
+    for (int i : candidates) {
+        const auto &path = index.paths.at(i);
+        const QChar *lowered = index.lowered.constData() + index.offsets[i];
+        int score = scoreFrom(path.constData(), lowered, index.nameStarts[i], path.size(), needle);
+        if (score >= 0)
+            score += nameBonus;
+        else
+            score = scoreFrom(path.constData(), lowered, 0, path.size(), needle);
+        if (score >= 0)
+            scored.emplace_back(score, i);
+    }
+    d->lastPattern = needle;
+    d->lastMatches.clear();
+    d->lastMatches.reserve(scored.size());
+    for (const auto &entry : scored)
+        d->lastMatches.push_back(entry.second);
+    if (total)
+        *total = scored.size();
+
+    // Better first, then shorter, then in the order of the paths.
+    const auto better = [&index](const std::pair<int, int> &left, const std::pair<int, int> &right) {
+        if (left.first != right.first)
+            return left.first > right.first;
+        const auto leftSize = index.paths.at(left.second).size();
+        const auto rightSize = index.paths.at(right.second).size();
+        if (leftSize != rightSize)
+            return leftSize < rightSize;
+        return left.second < right.second;
+    };
+    const auto end = scored.begin() + std::min<size_t>(std::max(limit, 0), scored.size());
+    std::partial_sort(scored.begin(), end, scored.end(), better);
+
+    QList<Match> result;
+    result.reserve(end - scored.begin());
+    for (auto it = scored.begin(); it != end; ++it)
+        result.append({index.paths.at(it->second), it->first});
+    return result;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <QObject>
+#include <QScopedPointer>
+#include <QStringList>
+
+class FileListCachePrivate;
+class FileWatchManager;
+class GlobFilter;
+
+// The files below a directory as `rg --files` lists them, so with ignore files
+// applied, kept in memory to match file names against as they are typed. The
+// whole tree is listed once; after that only the directories the file system
+// reports as changed are listed again. They are watched through a
+// FileWatchManager while its watches last and polled after that. The globs of
+// a search are applied as files are matched, so that one list serves them all.
+//
+// Files that appear in a directory none of the listed files were in (an
+// ignored one, say) are only found by the next refresh(); new directories
+// with files in them are found as they appear.
+class FileListCache : public QObject
+{
+    Q_OBJECT
+public:
+    struct Match {
+        // Relative to the root, with '/' separators.
+        QString file;
+        int score = 0;
+    };
+
+    FileListCache(const QString &root, FileWatchManager *watcher, QObject *parent = nullptr);
+    ~FileListCache();
+
+    QString root() const;
+    // Whether the tree was listed; until then there are no files.
+    bool isReady() const;
+    int count() const;
+
+    // The limit files that filter lets through that match pattern best, best
+    // first. The characters of pattern (but for spaces, and ignoring case)
+    // have to appear in a file's path in order; they score more in its name
+    // than in its directories, at the start of a word and right after one
+    // another. total, if given, is set to how many files match in all.
+    //
+    // Nothing is spawned: a 64-bit mask of the characters in each path rules
+    // out most of them in one pass over a flat array before any is scored, and
+    // a pattern that extends the last one only scores what matched that. What
+    // filter says of a file is remembered until the filter or the files change.
+    QList<Match> match(const QString &pattern, const GlobFilter &filter, int limit, int *total = nullptr) const;
+
+public slots:
+    // Lists the whole tree again.
+    void refresh();
+
+signals:
+    // The tree was listed, or some of it again.
+    void updated();
+    void failed(const QString &message);
+
+private:
+    const QScopedPointer<FileListCachePrivate> d;
+};
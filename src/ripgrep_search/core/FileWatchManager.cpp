@@ -0,0 +1,377 @@
+#include "FileWatchManager.hpp"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QSet>
+#include <QThread>
+#include <QTimer>
+
+// What we remember about a file that is not watched directly, so a directory
+// notification or a poll can tell which of its files actually changed.
+struct FileStamp {
+    qint64 mtime = -1;
+    qint64 size = -1;
+
+    bool operator==(const FileStamp &other) const
+    {
+        return mtime == other.mtime && size == other.size;
+    }
+};
+
+static FileStamp stampOf(const QString &file)
+{
+    QFileInfo info(file);
+    if (!info.exists())
+        return {};
+    return {info.lastModified().toMSecsSinceEpoch(), info.size()};
+}
+
+// addPath() does not say why it failed. A path that is there and readable can
+// only have been refused for want of watches; anything else is down to that
+// one path (it is unreadable, or was deleted meanwhile).
+static bool watchesExhausted(const QString &path)
+{
+    QFileInfo info(path);
+    return info.exists() && info.isReadable();
+}
+
+// The kernel limit is shared by every process of the user (and Kate itself
+// watches files too), so only claim a slice of it for search results.
+static int inotifyBudget()
+{
+    QFile limits(QStringLiteral("/proc/sys/fs/inotify/max_user_watches"));
+    if (limits.open(QIODevice::ReadOnly)) {
+        bool ok = false;
+        int max = limits.readAll().trimmed().toInt(&ok);
+        if (ok && max > 0)
+            return qBound(256, max / 8, 8192);
+    }
+    return 1024;
+}
+
+// Polled files are checked every tick. The files a directory watch covers are
+// checked a slice at a time, each of them once every this many ticks: the
+// watch reports files being added, removed or renamed, but not written to in
+// place.
+static constexpr int pollInterval = 2000;
+static constexpr int coveredRounds = 5;
+
+struct FileWatchManagerPrivate {
+    bool watchDirectly(const QString &file);
+    bool watchDirectory(const QString &file);
+    void rewatch(const QString &file);
+    void poll(const QString &file);
+    void updatePolling();
+    void check(const QStringList &candidates);
+    void sendChecks();
+    void checked(const QHash<QString, FileStamp> &changed);
+
+    FileWatchManager *q;
+    QFileSystemWatcher *watcher = nullptr;
+    QTimer *pollTimer = nullptr;
+    // The files are stat()ed on a thread of their own, one batch at a time, so
+    // that however many there are the GUI is not held up.
+    QThread checkThread;
+    QObject *checker = nullptr;
+    bool checking = false;
+    QSet<QString> toCheck;
+    // The files directory watches cover, in the order they are polled in.
+    QStringList covered;
+    int coveredNext = 0;
+    int budget = 0;
+    // Once the kernel runs out of watches there is no point asking again until
+    // the watches are cleared; everything after that is polled.
+    bool exhausted = false;
+    QSet<QString> files;
+    QSet<QString> directFiles;
+    QHash<QString, QSet<QString>> directoryFiles;
+    QSet<QString> polledFiles;
+    QHash<QString, FileStamp> stamps;
+    // The directories of file lists, by how many lists watch each. One may
+    // share its watch with directoryFiles.
+    QHash<QString, int> listedDirectories;
+};
+
+FileWatchManager::FileWatchManager(QObject *parent)
+    : QObject(parent)
+    , d(new FileWatchManagerPrivate)
+{
+    d->q = this;
+    d->budget = inotifyBudget();
+    d->watcher = new QFileSystemWatcher(this);
+    connect(d->watcher, &QFileSystemWatcher::fileChanged, this, [this](const QString &file) {
+        d->rewatch(file);
+        emit fileChanged(file);
+    });
+    connect(d->watcher, &QFileSystemWatcher::directoryChanged, this, [this](const QString &dir) {
+        if (d->listedDirectories.contains(dir))
+            emit directoryChanged(dir);
+        const auto files = d->directoryFiles.value(dir);
+        d->check(QStringList(files.cbegin(), files.cend()));
+    });
+
+    d->checker = new QObject;
+    d->checker->moveToThread(&d->checkThread);
+    d->checkThread.setObjectName(QStringLiteral("FileWatchManager"));
+    d->checkThread.start(QThread::LowPriority);
+
+    d->pollTimer = new QTimer(this);
+    d->pollTimer->setInterval(pollInterval);
+    connect(d->pollTimer, &QTimer::timeout, this, [this] {
+        QStringList files(d->polledFiles.cbegin(), d->polledFiles.cend());
+        const int slice = (d->covered.size() + coveredRounds - 1) / coveredRounds;
+        for (int i = 0; i < slice; ++i) {
+            if (d->coveredNext >= d->covered.size())
+                d->coveredNext = 0;
+            files.append(d->covered.at(d->coveredNext++));
+        }
+        d->check(files);
+    });
+}
+
+FileWatchManager::~FileWatchManager()
+{
+    // A batch still being checked reports to nothing.
+    d->checkThread.quit();
+    d->checkThread.wait();
+    delete d->checker;
+}
+
+bool FileWatchManagerPrivate::watchDirectly(const QString &file)
+{
+    if (exhausted || directFiles.size() >= budget)
+        return false;
+    if (!watcher->addPath(file)) {
+        // A file that is gone (for now) is found again by its directory's
+        // watch, or by polling.
+        if (!watchesExhausted(file))
+            return false;
+        exhausted = true;
+        qWarning() << "[ripgrep] Could not add a file watch; falling back to polling for the remaining files";
+        return false;
+    }
+    directFiles.insert(file);
+    return true;
+}
+
+bool FileWatchManagerPrivate::watchDirectory(const QString &file)
+{
+    const auto dir = QFileInfo(file).absolutePath();
+    if (auto it = directoryFiles.find(dir); it != directoryFiles.end()) {
+        it->insert(file);
+        stamps.insert(file, stampOf(file));
+        return true;
+    }
+    // Directory watches come out of a smaller second slice of the budget.
+    if (exhausted || directoryFiles.size() >= budget / 4)
+        return false;
+    if (!listedDirectories.contains(dir) && !watcher->addPath(dir)) {
+        if (!watchesExhausted(dir))
+            return false;
+        exhausted = true;
+        qWarning() << "[ripgrep] Could not add a directory watch; falling back to polling for the remaining files";
+        return false;
+    }
+    directoryFiles.insert(dir, {file});
+    stamps.insert(file, stampOf(file));
+    covered.append(file);
+    updatePolling();
+    return true;
+}
+
+// An atomic save (write a new file, rename it over the old one) leaves the
+// kernel's watch with the old file, which is gone; the watcher then no longer
+// lists the path. It is watched again if it is there by now, or else covered by
+// its directory's watch or polled, until it is.
+void FileWatchManagerPrivate::rewatch(const QString &file)
+{
+    if (!directFiles.contains(file) || watcher->files().contains(file))
+        return;
+    directFiles.remove(file);
+    if (QFileInfo::exists(file) && watcher->addPath(file)) {
+        directFiles.insert(file);
+        return;
+    }
+    if (!watchDirectory(file))
+        poll(file);
+}
+
+void FileWatchManagerPrivate::poll(const QString &file)
+{
+    polledFiles.insert(file);
+    stamps.insert(file, stampOf(file));
+    updatePolling();
+}
+
+void FileWatchManagerPrivate::updatePolling()
+{
+    if (polledFiles.isEmpty() && covered.isEmpty())
+        pollTimer->stop();
+    else if (!pollTimer->isActive())
+        pollTimer->start();
+}
+
+void FileWatchManagerPrivate::check(const QStringList &candidates)
+{
+    for (const auto &file : candidates)
+        toCheck.insert(file);
+    sendChecks();
+}
+
+// Hands the files waiting to be checked to the checking thread, with what they
+// looked like last; it sends back those that look different now.
+void FileWatchManagerPrivate::sendChecks()
+{
+    if (checking || toCheck.isEmpty())
+        return;
+    QHash<QString, FileStamp> known;
+    for (const auto &file : std::as_const(toCheck)) {
+        if (auto it = stamps.constFind(file); it != stamps.constEnd())
+            known.insert(file, it.value());
+    }
+    toCheck.clear();
+    if (known.isEmpty())
+        return;
+    checking = true;
+    QMetaObject::invokeMethod(
+        checker,
+        [this, known] {
+            QHash<QString, FileStamp> changed;
+            for (auto it = known.cbegin(); it != known.cend(); ++it) {
+                const auto stamp = stampOf(it.key());
+                if (!(stamp == it.value()))
+                    changed.insert(it.key(), stamp);
+            }
+            QMetaObject::invokeMethod(
+                q,
+                [this, changed] {
+                    checked(changed);
+                },
+                Qt::QueuedConnection);
+        },
+        Qt::QueuedConnection);
+}
+
+void FileWatchManagerPrivate::checked(const QHash<QString, FileStamp> &changed)
+{
+    checking = false;
+    for (auto it = changed.cbegin(); it != changed.cend(); ++it) {
+        // Files let go of meanwhile are not reported.
+        auto known = stamps.find(it.key());
+        if (known == stamps.end())
+            continue;
+        known.value() = it.value();
+        // A polled file that is back (see rewatch()) gets its watch again if
+        // there is one to spare.
+        if (it.value().size >= 0 && polledFiles.contains(it.key()) && watchDirectly(it.key())) {
+            polledFiles.remove(it.key());
+            stamps.remove(it.key());
+            updatePolling();
+        }
+        emit q->fileChanged(it.key());
+    }
+    sendChecks();
+}
+
+void FileWatchManager::watch(const QString &file)
+{
+    if (d->files.contains(file))
+        return;
+    d->files.insert(file);
+    if (d->watchDirectly(file) || d->watchDirectory(file))
+        return;
+    d->poll(file);
+}
+
+void FileWatchManager::unwatch(const QString &file)
+{
+    if (!d->files.remove(file))
+        return;
+    d->stamps.remove(file);
+    if (d->directFiles.remove(file)) {
+        d->watcher->removePath(file);
+        // A watch was given back, so the next file may get one again.
+        d->exhausted = false;
+    } else if (!d->polledFiles.remove(file)) {
+        d->covered.removeOne(file);
+        const auto dir = QFileInfo(file).absolutePath();
+        auto it = d->directoryFiles.find(dir);
+        if (it != d->directoryFiles.end() && it->remove(file) && it->isEmpty()) {
+            d->directoryFiles.erase(it);
+            if (!d->listedDirectories.contains(dir)) {
+                d->watcher->removePath(dir);
+                d->exhausted = false;
+            }
+        }
+    }
+    d->updatePolling();
+}
+
+void FileWatchManager::clear()
+{
+    d->pollTimer->stop();
+    if (!d->watcher->files().isEmpty())
+        d->watcher->removePaths(d->watcher->files());
+    for (auto it = d->directoryFiles.cbegin(); it != d->directoryFiles.cend(); ++it) {
+        if (!d->listedDirectories.contains(it.key()))
+            d->watcher->removePath(it.key());
+    }
+    d->exhausted = false;
+    d->files.clear();
+    d->directFiles.clear();
+    d->directoryFiles.clear();
+    d->polledFiles.clear();
+    d->covered.clear();
+    d->coveredNext = 0;
+    d->toCheck.clear();
+    d->stamps.clear();
+}
+
+FileWatchManager::Usage FileWatchManager::usage() const
+{
+    Usage usage;
+    usage.files = d->files.size();
+    usage.fileWatches = d->directFiles.size();
+    usage.directoryWatches = d->directoryFiles.size();
+    usage.polledFiles = d->polledFiles.size();
+    usage.listedDirectories = d->listedDirectories.size();
+    usage.budget = d->budget + d->budget / 4 + d->budget / 2;
+    return usage;
+}
+
+bool FileWatchManager::watchDirectory(const QString &dir)
+{
+    if (auto it = d->listedDirectories.find(dir); it != d->listedDirectories.end()) {
+        ++it.value();
+        return true;
+    }
+    // File lists get a slice of their own, so that a large tree does not
+    // leave the results without watches.
+    if (d->exhausted || d->listedDirectories.size() >= d->budget / 2)
+        return false;
+    if (!d->directoryFiles.contains(dir) && !d->watcher->addPath(dir)) {
+        if (!watchesExhausted(dir))
+            return false;
+        d->exhausted = true;
+        qWarning() << "[ripgrep] Could not add a directory watch; falling back to polling for the remaining directories";
+        return false;
+    }
+    d->listedDirectories.insert(dir, 1);
+    return true;
+}
+
+void FileWatchManager::unwatchDirectory(const QString &dir)
+{
+    auto it = d->listedDirectories.find(dir);
+    if (it == d->listedDirectories.end() || --it.value() > 0)
+        return;
+    d->listedDirectories.erase(it);
+    if (!d->directoryFiles.contains(dir)) {
+        d->watcher->removePath(dir);
+        d->exhausted = false;
+    }
+}
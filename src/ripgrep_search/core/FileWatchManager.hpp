@@ -0,0 +1,55 @@
+#pragma once
+#include <QObject>
+
+class FileWatchManagerPrivate;
+
+// Watches the files that produced search results and reports when one of them
+// changes on disk. Every file gets its own inotify watch until a budget derived
+// from fs.inotify.max_user_watches is spent; after that files are covered by a
+// watch on their directory, and once no more watches can be added at all they
+// fall back to polling their mtime/size on a timer. A directory watch does not
+// see files being written to in place, so the files it covers are polled too,
+// a few at a time. The polling is done on a thread of its own.
+//
+// The directories of file lists (see FileListCache) are watched out of the
+// same budget, so that however many lists there are the plugin as a whole
+// stays within its share of the kernel's watches.
+class FileWatchManager : public QObject
+{
+    Q_OBJECT
+public:
+    struct Usage {
+        int files = 0;
+        int fileWatches = 0;
+        int directoryWatches = 0;
+        int polledFiles = 0;
+        int listedDirectories = 0;
+        int budget = 0;
+    };
+
+    explicit FileWatchManager(QObject *parent = nullptr);
+    ~FileWatchManager();
+
+    void watch(const QString &file);
+    // Stops watching one file, giving back its watch (or, with the last file
+    // of a directory, the directory's).
+    void unwatch(const QString &file);
+    // Stops watching every file; the directories of file lists stay watched.
+    void clear();
+    Usage usage() const;
+
+    // Watches dir for a file list, returning false when there is no watch to
+    // spare; the list polls it then. A directory watched more than once (by
+    // lists of overlapping trees) needs as many unwatchDirectory() calls.
+    bool watchDirectory(const QString &dir);
+    void unwatchDirectory(const QString &dir);
+
+signals:
+    void fileChanged(const QString &file);
+    // Something was added to, removed from or renamed in a directory watched
+    // with watchDirectory().
+    void directoryChanged(const QString &dir);
+
+private:
+    const QScopedPointer<FileWatchManagerPrivate> d;
+};
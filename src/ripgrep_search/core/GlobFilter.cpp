@@ -0,0 +1,66 @@
+#include "GlobFilter.hpp"
+
+#include <algorithm>
+
+GlobFilter::GlobFilter(const QStringList &includeFiles, const QStringList &excludeFiles)
+    : m_includeFiles(includeFiles)
+    , m_excludeFiles(excludeFiles)
+    , m_include(compile(includeFiles, false))
+    , m_exclude(compile(excludeFiles, true))
+{
+}
+
+// With directories, a glob matches any directory in the path too, so it is
+// matched against the whole path.
+QList<GlobFilter::Glob> GlobFilter::compile(const QStringList &globs, bool directories)
+{
+    QList<Glob> result;
+    for (const auto &glob : globs) {
+        const auto pattern = QRegularExpression::wildcardToRegularExpression(glob, QRegularExpression::UnanchoredWildcardConversion);
+        if (directories)
+            result.append({QRegularExpression(QStringLiteral("(^|/)%1(/|$)").arg(pattern)), true});
+        else
+            result.append({QRegularExpression(QStringLiteral("(^|/)%1$").arg(pattern)), glob.contains(QLatin1Char('/'))});
+    }
+    return result;
+}
+
+bool GlobFilter::anyMatches(const QList<Glob> &globs, const QString &file)
+{
+    const auto name = file.mid(file.lastIndexOf(QLatin1Char('/')) + 1);
+    return std::any_of(globs.cbegin(), globs.cend(), [&](const Glob &glob) {
+        return glob.expression.match(glob.wholePath ? file : name).hasMatch();
+    });
+}
+
+bool GlobFilter::isEmpty() const
+{
+    return m_include.isEmpty() && m_exclude.isEmpty();
+}
+
+bool GlobFilter::matches(const QString &file) const
+{
+    return (m_include.isEmpty() || anyMatches(m_include, file)) && !anyMatches(m_exclude, file);
+}
+
+QStringList GlobFilter::filtered(const QStringList &files) const
+{
+    if (isEmpty())
+        return files;
+    QStringList result;
+    for (const auto &file : files) {
+        if (matches(file))
+            result.append(file);
+    }
+    return result;
+}
+
+bool GlobFilter::operator==(const GlobFilter &other) const
+{
+    return m_includeFiles == other.m_includeFiles && m_excludeFiles == other.m_excludeFiles;
+}
+
+bool GlobFilter::operator!=(const GlobFilter &other) const
+{
+    return !(*this == other);
+}
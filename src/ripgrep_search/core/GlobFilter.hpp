@@ -0,0 +1,37 @@
+#pragma once
+#include <QList>
+#include <QRegularExpression>
+#include <QStringList>
+
+// The include and exclude globs of a search, applied the way rg applies them
+// to a walk: a glob without a '/' matches the file name, any other the end of
+// the path, and an exclude glob leaves out the directories it matches as well
+// as the files. rg searches the files it is given whatever the globs say, so
+// file lists and buffers are filtered with this instead.
+class GlobFilter
+{
+public:
+    GlobFilter() = default;
+    GlobFilter(const QStringList &includeFiles, const QStringList &excludeFiles);
+
+    bool isEmpty() const;
+    bool matches(const QString &file) const;
+    QStringList filtered(const QStringList &files) const;
+
+    // Whether the globs are the same.
+    bool operator==(const GlobFilter &other) const;
+    bool operator!=(const GlobFilter &other) const;
+
+private:
+    struct Glob {
+        QRegularExpression expression;
+        bool wholePath = false;
+    };
+    static QList<Glob> compile(const QStringList &globs, bool directories);
+    static bool anyMatches(const QList<Glob> &globs, const QString &file);
+
+    QStringList m_includeFiles;
+    QStringList m_excludeFiles;
+    QList<Glob> m_include;
+    QList<Glob> m_exclude;
+};
@@ -0,0 +1,103 @@
+#include "LineIndex.hpp"
+
+#include <QFile>
+
+#include <algorithm>
+#include <cstring>
+
+QList<qint64> lineStartsOf(const char *data, qint64 size)
+{
+    QList<qint64> starts{0};
+    // Jump between candidate bytes with memchr rather than testing every byte;
+    // line breaks are sparse, so most of the file is skipped in bulk.
+    const char *end = data + size;
+    const char *p = data;
+    const char *lf = nullptr;
+    while (p < end) {
+        if (!lf || lf < p) {
+            lf = static_cast<const char *>(std::memchr(p, '\n', end - p));
+            if (!lf)
+                lf = end;
+        }
+        if (auto cr = static_cast<const char *>(std::memchr(p, '\r', lf - p))) {
+            if (cr + 1 < end && cr[1] == '\n')
+                ++cr; // "\r\n" is a single Kate line break
+            starts.append(cr + 1 - data);
+            p = cr + 1;
+        } else if (lf < end) {
+            starts.append(lf + 1 - data);
+            p = lf + 1;
+        } else {
+            break;
+        }
+    }
+    return starts;
+}
+
+QList<qint64> lineStartsOf(const QByteArray &bytes)
+{
+    return lineStartsOf(bytes.constData(), bytes.size());
+}
+
+int lineAtOffset(const QList<qint64> &starts, qint64 offset)
+{
+    auto it = std::upper_bound(starts.cbegin(), starts.cend(), offset);
+    return std::max<int>(0, int(it - starts.cbegin()) - 1);
+}
+
+int columnAtByte(const QString &line, qint64 byteInLine)
+{
+    // Walk the line adding up the UTF-8 length of each character instead of
+    // re-encoding it; navigation runs this for both ends of every jump.
+    const QChar *chars = line.constData();
+    const int n = line.size();
+    qint64 bytes = 0;
+    int i = 0;
+    while (i < n && bytes < byteInLine) {
+        const char16_t c = chars[i].unicode();
+        if (QChar::isHighSurrogate(c) && i + 1 < n && QChar::isLowSurrogate(chars[i + 1].unicode())) {
+            bytes += 4;
+            i += 2;
+        } else {
+            bytes += c < 0x80 ? 1 : (c < 0x800 ? 2 : 3);
+            ++i;
+        }
+    }
+    return i;
+}
+
+// The scan maps the file instead of reading it, so indexing a huge file costs
+// no more memory than the index itself.
+const QList<qint64> &LineIndexCache::lineStarts(const QString &file)
+{
+    if (auto it = m_starts.constFind(file); it != m_starts.constEnd())
+        return it.value();
+
+    QList<qint64> starts{0};
+    QFile f(file);
+    if (f.open(QIODevice::ReadOnly)) {
+        const qint64 size = f.size();
+        if (auto data = size > 0 ? f.map(0, size) : nullptr) {
+            starts = lineStartsOf(reinterpret_cast<const char *>(data), size);
+            f.unmap(data);
+        } else {
+            starts = lineStartsOf(f.readAll());
+        }
+    }
+    return m_starts.insert(file, std::move(starts)).value();
+}
+
+void LineIndexCache::insert(const QString &file, QList<qint64> starts)
+{
+    m_starts.insert(file, std::move(starts));
+}
+
+void LineIndexCache::remove(const QString &file)
+{
+    m_starts.remove(file);
+}
+
+void LineIndexCache::clear()
+{
+    m_starts.clear();
+}
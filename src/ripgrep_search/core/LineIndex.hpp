@@ -0,0 +1,30 @@
+#pragma once
+#include <QHash>
+#include <QList>
+#include <QString>
+
+// The byte offset of every line start in data, treating "\n", "\r\n" and a
+// lone '\r' as line breaks the way Kate does (ripgrep only breaks on '\n').
+QList<qint64> lineStartsOf(const char *data, qint64 size);
+QList<qint64> lineStartsOf(const QByteArray &bytes);
+
+// The line containing the byte at offset, given the line starts of its file.
+int lineAtOffset(const QList<qint64> &starts, qint64 offset);
+
+// The character (UTF-16 code unit) column of the byte at byteInLine of line,
+// whose text is UTF-8 encoded in the file. Offsets past the end map to the end.
+int columnAtByte(const QString &line, qint64 byteInLine);
+
+// Per-file cache of line starts, so a match's absolute byte offset can be
+// turned into the line Kate uses. Files are scanned once, on first use.
+class LineIndexCache
+{
+public:
+    const QList<qint64> &lineStarts(const QString &file);
+    void insert(const QString &file, QList<qint64> starts);
+    void remove(const QString &file);
+    void clear();
+
+private:
+    QHash<QString, QList<qint64>> m_starts;
+};
@@ -0,0 +1,111 @@
+#include "LineReader.hpp"
+
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+
+// Blocks start at multiples of this; a line crossing a boundary gets a block
+// of two.
+static constexpr qint64 blockSize = 64 * 1024;
+static constexpr size_t maxBlocks = 16;
+static constexpr qint64 checkInterval = 1000;
+
+struct LineReader::OpenFile {
+    QFile file;
+    qint64 modified = -1;
+    qint64 size = -1;
+    QElapsedTimer checked;
+};
+
+LineReader::LineReader() = default;
+
+LineReader::~LineReader() = default;
+
+void LineReader::clear()
+{
+    m_blocks.clear();
+    m_files.clear();
+}
+
+void LineReader::close(const QString &file)
+{
+    m_blocks.erase(std::remove_if(m_blocks.begin(),
+                                  m_blocks.end(),
+                                  [&file](const Block &block) {
+                                      return block.file == file;
+                                  }),
+                   m_blocks.end());
+    m_files.remove(file);
+}
+
+// The open file, once it is known to be as it was when its blocks were read;
+// reopened (and its blocks dropped) if it changed.
+LineReader::OpenFile *LineReader::open(const QString &file)
+{
+    if (auto opened = m_files.value(file)) {
+        if (!opened->checked.hasExpired(checkInterval))
+            return opened.get();
+        const QFileInfo info(file);
+        if (info.exists() && info.lastModified().toMSecsSinceEpoch() == opened->modified && info.size() == opened->size) {
+            opened->checked.start();
+            return opened.get();
+        }
+        close(file);
+    }
+
+    auto opened = std::make_shared<OpenFile>();
+    opened->file.setFileName(file);
+    if (!opened->file.open(QIODevice::ReadOnly))
+        return nullptr;
+    const QFileInfo info(file);
+    opened->modified = info.lastModified().toMSecsSinceEpoch();
+    opened->size = opened->file.size();
+    opened->checked.start();
+    m_files.insert(file, opened);
+    return opened.get();
+}
+
+QByteArray LineReader::read(const QString &file, qint64 offset, qint64 length, qint64 modified, qint64 size)
+{
+    auto opened = open(file);
+    if (!opened || opened->modified != modified || opened->size != size)
+        return QByteArray();
+    if (offset < 0 || length < 0 || offset + length > opened->size)
+        return QByteArray();
+
+    auto block = std::find_if(m_blocks.begin(), m_blocks.end(), [&](const Block &block) {
+        return block.file == file && block.offset <= offset && offset + length <= block.offset + block.data.size();
+    });
+    if (block != m_blocks.end()) {
+        // Read last now.
+        std::rotate(block, block + 1, m_blocks.end());
+    } else {
+        Block next;
+        next.file = file;
+        next.offset = offset / blockSize * blockSize;
+        const qint64 end = std::min(opened->size, (offset + length + blockSize - 1) / blockSize * blockSize);
+        if (!opened->file.seek(next.offset))
+            return QByteArray();
+        next.data = opened->file.read(end - next.offset);
+        // Cut short since it was opened; what is there now is not what was.
+        if (next.data.size() != end - next.offset) {
+            close(file);
+            return QByteArray();
+        }
+        if (m_blocks.size() >= maxBlocks) {
+            const auto oldest = m_blocks.front().file;
+            m_blocks.erase(m_blocks.begin());
+            // Files without blocks are not kept open.
+            if (oldest != file && std::none_of(m_blocks.begin(), m_blocks.end(), [&oldest](const Block &block) {
+                    return block.file == oldest;
+                }))
+                m_files.remove(oldest);
+        }
+        m_blocks.push_back(std::move(next));
+    }
+    const auto &last = m_blocks.back();
+    return last.data.mid(offset - last.offset, length);
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+// Reads byte ranges (the lines of results) back from the files they were
+// found in, a 64 KiB block at a time. The few blocks read last are kept, and
+// their files open, so the rows on screen, which are close together, cost a
+// copy each. A file's blocks are let go of as soon as its modification time or
+// size is seen to change; that is checked at most once a second per file. The
+// bytes are read rather than mapped, so a file truncated in place meanwhile
+// only makes a read come up short.
+//
+// Not thread-safe; a thread that reads files back needs a reader of its own.
+class LineReader
+{
+public:
+    LineReader();
+    ~LineReader();
+
+    // The length bytes at offset in file, or a null array when the file is
+    // gone, shorter than that, cannot be read, or no longer has the given
+    // modification time (ms since the epoch) and size.
+    QByteArray read(const QString &file, qint64 offset, qint64 length, qint64 modified, qint64 size);
+    void clear();
+
+private:
+    struct OpenFile;
+    struct Block {
+        QString file;
+        qint64 offset = 0;
+        QByteArray data;
+    };
+
+    OpenFile *open(const QString &file);
+    void close(const QString &file);
+
+    QHash<QString, std::shared_ptr<OpenFile>> m_files;
+    // Least recently read first.
+    std::vector<Block> m_blocks;
+};
@@ -0,0 +1,328 @@
+#include "ResultExporter.hpp"
+#include "LineReader.hpp"
+#include "ResultStore.hpp"
+
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QSaveFile>
+#include <QThread>
+#include <QUrl>
+
+// Results are handed to the writing thread this many at a time, and written
+// out whenever this much output has piled up.
+static constexpr qsizetype batchSize = 4096;
+static constexpr qsizetype flushSize = 1024 * 1024;
+
+struct ExportRecord {
+    QString file;
+    QString text;
+    int line;
+    int start;
+    int end;
+    qint64 byteStart;
+    qint64 byteEnd;
+    // A row of a store that let go of its text, which is read back on the
+    // writing thread.
+    DroppedText dropped;
+};
+
+// Where a character offset into a match's text falls: the text holds every
+// line the match spans in multiline mode.
+struct TextPosition {
+    int line;
+    // 1-based, in UTF-16 code units like the columns the results are shown with.
+    int column;
+    // The line the offset is on, without its line break.
+    QString lineText;
+};
+
+static TextPosition positionAt(const ExportRecord &record, int offset)
+{
+    const auto &text = record.text;
+    offset = qBound(0, offset, int(text.size()));
+    int line = record.line;
+    qsizetype lineStart = 0;
+    for (qsizetype i = text.indexOf(QLatin1Char('\n')); i >= 0 && i < offset; i = text.indexOf(QLatin1Char('\n'), i + 1)) {
+        ++line;
+        lineStart = i + 1;
+    }
+    auto lineEnd = text.indexOf(QLatin1Char('\n'), lineStart);
+    if (lineEnd < 0)
+        lineEnd = text.size();
+    if (lineEnd > lineStart && text.at(lineEnd - 1) == QLatin1Char('\r'))
+        --lineEnd;
+    return {line, int(offset - lineStart) + 1, text.mid(lineStart, lineEnd - lineStart)};
+}
+
+// SARIF wants URIs; untitled and remote buffers are reported under a label
+// that is not a path, which is kept as it is.
+static QString artifactUri(const QString &file)
+{
+    return QFileInfo(file).isAbsolute() ? QUrl::fromLocalFile(file).toString(QUrl::FullyEncoded) : file;
+}
+
+static QByteArray sarifHeader()
+{
+    const QJsonObject rule{{"id", "match"}, {"shortDescription", QJsonObject{{"text", "Search match"}}}};
+    const QJsonObject driver{{"name", "ripgrep search"}, {"rules", QJsonArray{rule}}};
+    // The log is streamed: everything up to the results array is written
+    // first, then one result at a time, then the closing brackets.
+    return QByteArrayLiteral("{\"$schema\":\"https://json.schemastore.org/sarif-2.1.0.json\",\"version\":\"2.1.0\",\"runs\":[{\"tool\":")
+        + QJsonDocument(QJsonObject{{"driver", driver}}).toJson(QJsonDocument::Compact)
+        + QByteArrayLiteral(",\"columnKind\":\"utf16CodeUnits\",\"results\":[\n");
+}
+
+static QByteArray sarifFooter()
+{
+    return QByteArrayLiteral("]}]}\n");
+}
+
+// Lives on the exporter's thread and does all the formatting and writing.
+class ExportWriter : public QObject
+{
+    Q_OBJECT
+public:
+    ExportWriter(const QString &path, ResultExporter::Format format)
+        : file(path)
+        , format(format)
+    {
+    }
+
+    void write(const QList<ExportRecord> &records)
+    {
+        if (!open())
+            return;
+        for (const auto &record : records) {
+            if (record.dropped.offset < 0) {
+                append(record);
+            } else {
+                auto read = record;
+                read.text = ResultStore::readText(record.dropped, &reader);
+                // Whatever is at the offset now is not what was found there.
+                if (read.text.isNull()) {
+                    ++skipped;
+                    continue;
+                }
+                append(read);
+            }
+            if (buffer.size() >= flushSize)
+                flush();
+        }
+    }
+
+    void close()
+    {
+        if (open()) {
+            if (format == ResultExporter::Sarif)
+                buffer += sarifFooter();
+            flush();
+            if (error.isEmpty() && !file.commit())
+                error = file.errorString();
+        }
+        emit done(count, skipped, error);
+    }
+
+signals:
+    void done(qint64 count, qint64 skipped, const QString &error);
+
+private:
+    // Opened on first use rather than up front so that a failure is reported
+    // from this thread, with the rest of the outcome.
+    bool open()
+    {
+        if (opened)
+            return error.isEmpty();
+        opened = true;
+        if (!file.open(QIODevice::WriteOnly)) {
+            error = file.errorString();
+            return false;
+        }
+        if (format == ResultExporter::Sarif)
+            buffer += sarifHeader();
+        return true;
+    }
+
+    void flush()
+    {
+        if (error.isEmpty() && file.write(buffer) != buffer.size()) {
+            error = file.errorString();
+            file.cancelWriting();
+        }
+        buffer.clear();
+    }
+
+    void append(const ExportRecord &record)
+    {
+        const auto start = positionAt(record, record.start);
+        switch (format) {
+        case ResultExporter::Grep:
+            buffer += record.file.toUtf8();
+            buffer += ':' + QByteArray::number(start.line) + ':' + QByteArray::number(start.column) + ':';
+            buffer += start.lineText.toUtf8();
+            buffer += '\n';
+            break;
+        case ResultExporter::JsonLines: {
+            const auto end = positionAt(record, record.end);
+            const QJsonObject object{
+                {"file", record.file},
+                {"line", start.line},
+                {"column", start.column},
+                {"end_line", end.line},
+                {"end_column", end.column},
+                {"byte_start", record.byteStart},
+                {"byte_end", record.byteEnd},
+                {"match", record.text.mid(record.start, record.end - record.start)},
+                {"text", start.lineText},
+            };
+            buffer += QJsonDocument(object).toJson(QJsonDocument::Compact);
+            buffer += '\n';
+            break;
+        }
+        case ResultExporter::Sarif: {
+            const auto end = positionAt(record, record.end);
+            const QJsonObject region{
+                {"startLine", start.line},
+                {"startColumn", start.column},
+                {"endLine", end.line},
+                {"endColumn", end.column},
+                {"byteOffset", record.byteStart},
+                {"byteLength", record.byteEnd - record.byteStart},
+                {"snippet", QJsonObject{{"text", start.lineText}}},
+            };
+            const QJsonObject location{
+                {"physicalLocation", QJsonObject{{"artifactLocation", QJsonObject{{"uri", artifactUri(record.file)}}}, {"region", region}}},
+            };
+            const QJsonObject result{
+                {"ruleId", "match"},
+                {"level", "note"},
+                {"message", QJsonObject{{"text", record.text.mid(record.start, record.end - record.start)}}},
+                {"locations", QJsonArray{location}},
+            };
+            if (count > 0)
+                buffer += ",\n";
+            buffer += QJsonDocument(result).toJson(QJsonDocument::Compact);
+            break;
+        }
+        }
+        ++count;
+    }
+
+    QSaveFile file;
+    ResultExporter::Format format;
+    QByteArray buffer;
+    qint64 count = 0;
+    qint64 skipped = 0;
+    QString error;
+    bool opened = false;
+    LineReader reader;
+};
+
+class ResultExporterPrivate
+{
+public:
+    void send();
+
+    QString path;
+    ResultExporter::Format format;
+    QThread thread;
+    ExportWriter *writer = nullptr;
+    QList<ExportRecord> batch;
+};
+
+// Queued calls to the writer run on its thread in the order they were made.
+void ResultExporterPrivate::send()
+{
+    if (batch.isEmpty())
+        return;
+    QMetaObject::invokeMethod(
+        writer,
+        [writer = writer, records = std::move(batch)] {
+            writer->write(records);
+        },
+        Qt::QueuedConnection);
+    batch = {};
+    batch.reserve(batchSize);
+}
+
+ResultExporter::ResultExporter(const QString &path, Format format, QObject *parent)
+    : QObject(parent)
+    , d(new ResultExporterPrivate)
+{
+    d->path = path;
+    d->format = format;
+    d->batch.reserve(batchSize);
+    d->writer = new ExportWriter(path, format);
+    d->writer->moveToThread(&d->thread);
+    connect(d->writer, &ExportWriter::done, this, [this](qint64 count, qint64 skipped, const QString &error) {
+        d->thread.quit();
+        emit finished(count, skipped, error);
+    });
+    d->thread.setObjectName(QStringLiteral("ResultExporter"));
+    d->thread.start(QThread::LowPriority);
+}
+
+ResultExporter::~ResultExporter()
+{
+    // Whatever is still queued is dropped along with the thread's event loop,
+    // and the unfinished file with the writer.
+    d->thread.quit();
+    d->thread.wait();
+    delete d->writer;
+}
+
+ResultExporter::Format ResultExporter::formatForPath(const QString &path)
+{
+    const auto suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == QLatin1String("jsonl") || suffix == QLatin1String("ndjson"))
+        return JsonLines;
+    if (suffix == QLatin1String("sarif"))
+        return Sarif;
+    return Grep;
+}
+
+QString ResultExporter::path() const
+{
+    return d->path;
+}
+
+ResultExporter::Format ResultExporter::format() const
+{
+    return d->format;
+}
+
+void ResultExporter::addMatch(const QString &file, const QString &text, int line, int start, int end, qint64 byteStart, qint64 byteEnd)
+{
+    d->batch.append({file, text, line, start, end, byteStart, byteEnd, {}});
+    if (d->batch.size() >= batchSize)
+        d->send();
+}
+
+// Only the rows are walked here; the strings they hold are shared with the
+// batches, not copied. The texts the store let go of are read back on the
+// writing thread, not here.
+void ResultExporter::addStore(const ResultStore &store)
+{
+    for (auto file : std::as_const(store.root()->children)) {
+        for (auto match : std::as_const(file->children)) {
+            d->batch.append({match->file, match->text, match->line, match->start, match->end, match->byteStart, match->byteEnd, store.droppedText(match)});
+            if (d->batch.size() >= batchSize)
+                d->send();
+        }
+    }
+}
+
+void ResultExporter::finish()
+{
+    d->send();
+    QMetaObject::invokeMethod(
+        d->writer,
+        [writer = d->writer] {
+            writer->close();
+        },
+        Qt::QueuedConnection);
+}
+
+#include "ResultExporter.moc"
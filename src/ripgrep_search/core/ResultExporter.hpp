@@ -0,0 +1,58 @@
+#pragma once
+#include <QObject>
+#include <QScopedPointer>
+#include <QString>
+
+class ResultExporterPrivate;
+class ResultStore;
+
+// Writes search results to a file as they come, on a thread of its own, so
+// that exporting a huge result set neither blocks the GUI nor has to go
+// through the result view first.
+//
+// Results are fed in the same form RipgrepCommand::matchFound reports them,
+// either straight from the search or from a ResultStore; they are handed to
+// the writing thread in batches. The file is only replaced once finish() has
+// written all of them: an exporter destroyed before that leaves it untouched.
+class ResultExporter : public QObject
+{
+    Q_OBJECT
+public:
+    enum Format {
+        // file:line:column:text, one line per match, like grep -n or rg --vimgrep.
+        Grep,
+        // One JSON object per match and line.
+        JsonLines,
+        // A SARIF 2.1.0 log with one result per match, for code scanning tools.
+        Sarif,
+    };
+
+    ResultExporter(const QString &path, Format format, QObject *parent = nullptr);
+    ~ResultExporter();
+
+    // The format a file name asks for by its suffix (.jsonl, .sarif, anything
+    // else is grep style).
+    static Format formatForPath(const QString &path);
+
+    QString path() const;
+    Format format() const;
+
+    // Queues every match in store, in the order shown. The texts the store
+    // let go of are read back from the files as they are written; matches
+    // whose files have changed since are skipped.
+    void addStore(const ResultStore &store);
+    // Tells that no more results follow; finished() is emitted once they are
+    // all written.
+    void finish();
+
+public slots:
+    void addMatch(const QString &file, const QString &text, int line, int start, int end, qint64 byteStart, qint64 byteEnd);
+
+signals:
+    // How many matches were written and how many skipped, or why the file
+    // could not be written.
+    void finished(qint64 count, qint64 skipped, const QString &error);
+
+private:
+    const QScopedPointer<ResultExporterPrivate> d;
+};
@@ -0,0 +1,734 @@
+#include "ResultStore.hpp"
+#include "LineReader.hpp"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+// Identity of a match row across re-runs of the same search.
+struct ResultKey {
+    QString file;
+    qint64 byteStart;
+    size_t textHash;
+
+    bool operator==(const ResultKey &other) const
+    {
+        return byteStart == other.byteStart && textHash == other.textHash && file == other.file;
+    }
+};
+
+static inline size_t qHash(const ResultKey &key, size_t seed = 0)
+{
+    return qHashMulti(seed, key.file, key.byteStart, key.textHash);
+}
+
+static inline ResultKey keyOf(const ResultNode *node)
+{
+    return {node->file, node->byteStart, node->textHash};
+}
+
+// Estimates for memoryUsage(): a node with its text and the pointer to it in
+// its parent, plus a lookup hash entry for the nodes that have one; a context
+// line with its text and map node.
+static inline qint64 nodeBytes(const ResultNode *node)
+{
+    constexpr qint64 hashEntry = sizeof(void *) + sizeof(QString) + 2 * sizeof(qint64);
+    const qint64 lookup = node->kind == ResultNode::Match || node->kind == ResultNode::File ? hashEntry : 0;
+    return sizeof(ResultNode) + sizeof(void *) + node->text.size() * sizeof(QChar) + lookup;
+}
+
+static inline qint64 contextLineBytes(const QString &text)
+{
+    return sizeof(ContextLine) + 4 * sizeof(void *) + text.size() * sizeof(QChar);
+}
+
+// What a file looked like when the store first let go of a text in it.
+struct TextStamp {
+    qint64 modified = -1;
+    qint64 size = -1;
+};
+
+static TextStamp stampOf(const QString &file)
+{
+    const QFileInfo info(file);
+    return {info.lastModified().toMSecsSinceEpoch(), info.size()};
+}
+
+// The line a file's most recent match is on, and the row of its first match.
+struct LastMatch {
+    int line;
+    ResultNode *node;
+};
+
+struct ResultStorePrivate {
+    void insertChild(ResultNode *parent, int row, ResultNode *node);
+    void removeChildren(ResultNode *parent, int first, int count);
+    void destroy(ResultNode *node);
+    void forget(ResultNode *node);
+    void removeUnseen(ResultNode *parent);
+    void markSeen(ResultNode *node);
+    void changed(ResultNode *node);
+    int matchInsertionRow(const ResultNode *file, qint64 byteStart) const;
+    int fileInsertionRow(const QString &key) const;
+    QString sortKey(ResultNode *file);
+    void resort();
+    void updateFileState(ResultNode *file);
+    void attachContext(ResultNode *match, const QString &file, int line);
+    const ContextLine *contextLine(const QString &file, int line) const;
+    void keepText(ResultNode *match);
+    void dropText(ResultNode *match);
+    void forgetText(const ResultNode *match);
+    void purgeTexts();
+
+    ResultStore *q;
+    ResultStoreListener *listener = nullptr;
+    ResultNode root;
+    int matches = 0;
+    qint64 bytes = 0;
+    qint64 contextBytes = 0;
+    qint64 previousContextBytes = 0;
+    bool merging = false;
+    ResultStore::SortOrder sortOrder = ResultStore::SortByPath;
+    QHash<QString, ResultNode *> files;
+    QHash<ResultKey, ResultNode *> results;
+    // Rows reported (again) by the search currently being merged.
+    QSet<ResultNode *> seen;
+    int contextBefore = 0;
+    int contextAfter = 0;
+    // Lines around the matches, per file and line number. Each line is stored
+    // once, however many matches it is shown below (adjacent and overlapping
+    // context windows share their lines); context rows only refer to it. While
+    // a re-search is merged, the previous run's lines remain readable until
+    // the new run has reported them again.
+    QHash<QString, QMap<int, ContextLine>> context;
+    QHash<QString, QMap<int, ContextLine>> previousContext;
+    QHash<QString, LastMatch> lastMatch;
+    int textBudget = -1;
+    // Match rows holding their text, in the order they got it. Rows that are
+    // gone by the time they come up are skipped; staleTexts counts them, and
+    // once they are half the queue it is rebuilt without them.
+    std::deque<ResultKey> texts;
+    int staleTexts = 0;
+    QSet<QString> bufferFiles;
+    // Taken when a file's first text is let go of, and again once a search
+    // has reported the file anew.
+    QHash<QString, TextStamp> stamps;
+    LineReader reader;
+};
+
+ResultStore::ResultStore()
+    : d(new ResultStorePrivate)
+{
+    d->q = this;
+}
+
+ResultStore::~ResultStore()
+{
+    for (auto file : std::as_const(d->root.children))
+        d->destroy(file);
+}
+
+void ResultStore::setListener(ResultStoreListener *listener)
+{
+    d->listener = listener;
+}
+
+ResultNode *ResultStore::root() const
+{
+    return &d->root;
+}
+
+int ResultStore::rowOf(const ResultNode *node) const
+{
+    if (!node->parent)
+        return 0;
+    const auto &siblings = node->parent->children;
+    // Rows only move when rows are inserted or removed before them, so the
+    // last known row is nearly always still right.
+    if (node->rowHint < siblings.size() && siblings.at(node->rowHint) == node)
+        return node->rowHint;
+    node->rowHint = siblings.indexOf(node);
+    return node->rowHint;
+}
+
+int ResultStore::fileCount() const
+{
+    return d->root.children.size();
+}
+
+int ResultStore::matchCount() const
+{
+    return d->matches;
+}
+
+qint64 ResultStore::memoryUsage() const
+{
+    return d->bytes + d->contextBytes + d->previousContextBytes;
+}
+
+void ResultStore::clear()
+{
+    if (d->listener)
+        d->listener->aboutToReset();
+    for (auto file : std::as_const(d->root.children))
+        d->destroy(file);
+    d->root.children.clear();
+    d->matches = 0;
+    d->bytes = 0;
+    d->contextBytes = 0;
+    d->previousContextBytes = 0;
+    d->merging = false;
+    d->files.clear();
+    d->results.clear();
+    d->seen.clear();
+    d->context.clear();
+    d->previousContext.clear();
+    d->lastMatch.clear();
+    d->texts.clear();
+    d->staleTexts = 0;
+    d->stamps.clear();
+    d->reader.clear();
+    if (d->listener)
+        d->listener->reset();
+}
+
+void ResultStore::beginMerge()
+{
+    d->merging = true;
+    d->seen.clear();
+    d->previousContext = std::move(d->context);
+    d->context.clear();
+    d->previousContextBytes = d->contextBytes;
+    d->contextBytes = 0;
+    d->lastMatch.clear();
+}
+
+void ResultStore::beginMerge(const QSet<QString> &files)
+{
+    beginMerge();
+    for (auto file : std::as_const(d->root.children)) {
+        if (files.contains(file->file))
+            continue;
+        d->markSeen(file);
+        // Nothing reports this file's context lines again, so they are carried
+        // over as they are.
+        auto previous = d->previousContext.find(file->file);
+        if (previous == d->previousContext.end())
+            continue;
+        for (const auto &line : std::as_const(previous.value())) {
+            const qint64 lineBytes = contextLineBytes(line.text);
+            d->contextBytes += lineBytes;
+            d->previousContextBytes -= lineBytes;
+        }
+        d->context.insert(file->file, std::move(previous.value()));
+        d->previousContext.erase(previous);
+    }
+}
+
+void ResultStore::endMerge()
+{
+    if (!d->merging)
+        return;
+    d->merging = false;
+    d->removeUnseen(&d->root);
+    d->seen.clear();
+    d->previousContext.clear();
+    d->previousContextBytes = 0;
+    d->lastMatch.clear();
+    // Files are inserted in path order as they arrive; other orders depend on
+    // what the whole search found, so they are settled once it is done.
+    if (d->sortOrder != SortByPath)
+        d->resort();
+}
+
+void ResultStorePrivate::insertChild(ResultNode *parent, int row, ResultNode *node)
+{
+    if (listener)
+        listener->rowsAboutToBeInserted(parent, row, row);
+    node->parent = parent;
+    node->rowHint = row;
+    parent->children.insert(row, node);
+    bytes += nodeBytes(node);
+    if (node->kind == ResultNode::Match)
+        ++matches;
+    if (listener)
+        listener->rowsInserted();
+}
+
+void ResultStorePrivate::removeChildren(ResultNode *parent, int first, int count)
+{
+    if (listener)
+        listener->rowsAboutToBeRemoved(parent, first, first + count - 1);
+    for (int i = first; i < first + count; ++i) {
+        forget(parent->children.at(i));
+        destroy(parent->children.at(i));
+    }
+    parent->children.remove(first, count);
+    if (listener)
+        listener->rowsRemoved();
+}
+
+void ResultStorePrivate::destroy(ResultNode *node)
+{
+    for (auto child : std::as_const(node->children))
+        destroy(child);
+    bytes -= nodeBytes(node);
+    if (node->kind == ResultNode::Match)
+        --matches;
+    delete node;
+}
+
+void ResultStorePrivate::forget(ResultNode *node)
+{
+    if (node->kind == ResultNode::File) {
+        for (auto match : std::as_const(node->children)) {
+            results.remove(keyOf(match));
+            forgetText(match);
+        }
+        files.remove(node->file);
+        stamps.remove(node->file);
+    } else if (node->kind == ResultNode::Match) {
+        results.remove(keyOf(node));
+        forgetText(node);
+    }
+    if (staleTexts > int(texts.size()) / 2)
+        purgeTexts();
+}
+
+// Drop every row below parent that the merged search did not report, removing
+// contiguous runs at once so a view sees as few removals as possible, then
+// recurse into the surviving rows.
+void ResultStorePrivate::removeUnseen(ResultNode *parent)
+{
+    int end = parent->children.size();
+    for (int row = end - 1; row >= -1; --row) {
+        bool keep = row < 0 || seen.contains(parent->children.at(row));
+        if (!keep)
+            continue;
+        if (row + 1 < end)
+            removeChildren(parent, row + 1, end - row - 1);
+        end = row;
+    }
+
+    for (auto child : std::as_const(parent->children)) {
+        if (!child->children.isEmpty())
+            removeUnseen(child);
+        if (child->kind == ResultNode::File)
+            updateFileState(child);
+    }
+}
+
+void ResultStorePrivate::markSeen(ResultNode *node)
+{
+    seen.insert(node);
+    for (auto child : std::as_const(node->children))
+        markSeen(child);
+}
+
+void ResultStorePrivate::changed(ResultNode *node)
+{
+    if (listener) {
+        int row = q->rowOf(node);
+        listener->rowsChanged(node->parent, row, row);
+    }
+}
+
+int ResultStorePrivate::matchInsertionRow(const ResultNode *file, qint64 byteStart) const
+{
+    // ripgrep reports the matches of a file in order, so the rows below a file
+    // are sorted by byte offset and a new one can be placed by bisection.
+    auto it = std::lower_bound(file->children.cbegin(), file->children.cend(), byteStart, [](const ResultNode *match, qint64 offset) {
+        return match->byteStart < offset;
+    });
+    return int(it - file->children.cbegin());
+}
+
+int ResultStorePrivate::fileInsertionRow(const QString &key) const
+{
+    auto it = std::lower_bound(root.children.cbegin(), root.children.cend(), key, [](const ResultNode *file, const QString &key) {
+        return file->sortKey < key;
+    });
+    return int(it - root.children.cbegin());
+}
+
+ResultStore::SortOrder ResultStore::sortOrder() const
+{
+    return d->sortOrder;
+}
+
+void ResultStore::setSortOrder(SortOrder order)
+{
+    if (d->sortOrder == order)
+        return;
+    d->sortOrder = order;
+    d->resort();
+}
+
+// ripgrep searches files on many threads and reports them in whatever order
+// the threads finish, so the file order is ours to impose. Keys are strings
+// that compare in the wanted order and always end in the path, making the
+// order total and therefore the same on every run.
+QString ResultStorePrivate::sortKey(ResultNode *file)
+{
+    switch (sortOrder) {
+    case ResultStore::SortByMatchCount: {
+        // Most matches first.
+        const int rank = std::numeric_limits<int>::max() - file->children.size();
+        return QStringLiteral("%1/%2").arg(rank, 10, 10, QLatin1Char('0')).arg(file->file);
+    }
+    case ResultStore::SortByModified: {
+        if (file->modified < 0) {
+            QFileInfo info(file->file);
+            file->modified = info.exists() ? info.lastModified().toMSecsSinceEpoch() : 0;
+        }
+        // Most recently modified first.
+        const qint64 rank = std::numeric_limits<qint64>::max() - file->modified;
+        return QStringLiteral("%1/%2").arg(rank, 19, 10, QLatin1Char('0')).arg(file->file);
+    }
+    case ResultStore::SortByPath:
+    default:
+        return file->file;
+    }
+}
+
+// Re-order the stored files in place; nothing is searched again. The matches
+// below each file keep their order.
+void ResultStorePrivate::resort()
+{
+    for (auto file : std::as_const(root.children))
+        file->sortKey = sortKey(file);
+    if (listener)
+        listener->layoutAboutToBeChanged();
+    std::stable_sort(root.children.begin(), root.children.end(), [](const ResultNode *a, const ResultNode *b) {
+        return a->sortKey < b->sortKey;
+    });
+    for (int i = 0; i < root.children.size(); ++i)
+        root.children.at(i)->rowHint = i;
+    if (listener)
+        listener->layoutChanged();
+}
+
+void ResultStore::addFile(const QString &file)
+{
+    if (auto existing = d->files.value(file)) {
+        d->seen.insert(existing);
+        // The file may have changed since its texts were let go of. Those that
+        // are reported again get theirs back in addMatch(); the others are
+        // removed by endMerge(), and until then their hash tells if they hold.
+        if (d->stamps.contains(file))
+            d->stamps.insert(file, stampOf(file));
+        return;
+    }
+
+    auto node = new ResultNode;
+    node->kind = ResultNode::File;
+    node->file = file;
+    node->text = QFileInfo(file).fileName();
+    node->sortKey = d->sortKey(node);
+    d->insertChild(&d->root, d->fileInsertionRow(node->sortKey), node);
+    d->files.insert(file, node);
+    if (d->merging)
+        d->seen.insert(node);
+}
+
+void ResultStore::addMatch(const QString &file, const QString &text, int line, int start, int end, qint64 byteStart, qint64 byteEnd)
+{
+    // Several rg processes may report at once, so look the file up rather than
+    // assuming the last reported file is the one this match belongs to.
+    auto fileNode = d->files.value(file);
+    if (fileNode == nullptr)
+        return;
+
+    ResultKey key{file, byteStart, qHash(text)};
+    auto node = d->results.value(key);
+    if (node) {
+        // Same match as before: keep the row (and its check state), only
+        // refreshing whatever else about it may have moved. An identical
+        // re-run changes nothing and tells the listener nothing.
+        d->seen.insert(node);
+        if (node->textOffset >= 0) {
+            node->text = text;
+            node->textOffset = -1;
+            d->bytes += text.size() * sizeof(QChar);
+            d->keepText(node);
+        }
+        if (node->line != line || node->start != start || node->end != end || node->byteEnd != byteEnd) {
+            node->line = line;
+            node->start = start;
+            node->end = end;
+            node->byteEnd = byteEnd;
+            d->changed(node);
+        }
+    } else {
+        node = new ResultNode;
+        node->kind = ResultNode::Match;
+        node->file = fileNode->file;
+        node->text = text;
+        node->textHash = key.textHash;
+        node->line = line;
+        node->start = start;
+        node->end = end;
+        node->byteStart = byteStart;
+        node->byteEnd = byteEnd;
+        d->insertChild(fileNode, d->matchInsertionRow(fileNode, byteStart), node);
+        d->results.insert(key, node);
+        d->keepText(node);
+        if (d->merging)
+            d->seen.insert(node);
+        if (fileNode->checkState != Qt::Checked)
+            d->updateFileState(fileNode);
+    }
+
+    // The context of a line is shown below its first match only. Lines before
+    // it have already been reported; lines after it follow in addContext().
+    auto last = d->lastMatch.find(file);
+    if (last != d->lastMatch.end() && last->line == line)
+        return;
+    d->lastMatch.insert(file, {line, node});
+    if (d->contextBefore > 0) {
+        if (auto lines = d->context.constFind(file); lines != d->context.constEnd()) {
+            for (auto it = lines->lowerBound(line - d->contextBefore); it != lines->constEnd() && it.key() < line; ++it)
+                d->attachContext(node, file, it.key());
+        }
+    }
+}
+
+void ResultStore::setContextLines(int before, int after)
+{
+    d->contextBefore = before;
+    d->contextAfter = after;
+}
+
+void ResultStore::addContext(const QString &file, const QString &text, int line, qint64 byteOffset)
+{
+    auto &lines = d->context[file];
+    if (!lines.contains(line))
+        d->contextBytes += contextLineBytes(text);
+    lines.insert(line, {text, byteOffset});
+    auto last = d->lastMatch.constFind(file);
+    if (last != d->lastMatch.constEnd() && line > last->line && line - last->line <= d->contextAfter)
+        d->attachContext(last->node, file, line);
+}
+
+const ContextLine *ResultStore::contextLine(const ResultNode *node) const
+{
+    return d->contextLine(node->file, node->line);
+}
+
+const ContextLine *ResultStorePrivate::contextLine(const QString &file, int line) const
+{
+    for (const auto *store : {&context, &previousContext}) {
+        if (auto lines = store->constFind(file); lines != store->constEnd()) {
+            if (auto it = lines->constFind(line); it != lines->constEnd())
+                return &it.value();
+        }
+    }
+    return nullptr;
+}
+
+QString ResultStore::matchText(const ResultNode *node) const
+{
+    if (node->textOffset < 0)
+        return node->text;
+    return readText(droppedText(node), &d->reader);
+}
+
+DroppedText ResultStore::droppedText(const ResultNode *node) const
+{
+    if (node->textOffset < 0)
+        return {};
+    const auto stamp = d->stamps.value(node->file);
+    return {node->file, node->textOffset, node->textBytes, node->textHash, stamp.modified, stamp.size};
+}
+
+// The hash catches what the file's modification time and size may not: a
+// change within the same millisecond and size.
+QString ResultStore::readText(const DroppedText &text, LineReader *reader)
+{
+    const auto bytes = reader->read(text.file, text.offset, text.bytes, text.modified, text.size);
+    if (bytes.isNull())
+        return QString();
+    const auto result = QString::fromUtf8(bytes);
+    return qHash(result) == text.hash ? result : QString();
+}
+
+void ResultStore::setTextBudget(int rows)
+{
+    d->textBudget = rows;
+}
+
+void ResultStore::setBufferFiles(const QSet<QString> &files)
+{
+    d->bufferFiles = files;
+}
+
+// Queue a match row that just got its text, letting go of the text of the
+// rows that got theirs first while more than the budget hold one.
+void ResultStorePrivate::keepText(ResultNode *match)
+{
+    if (textBudget < 0 || bufferFiles.contains(match->file))
+        return;
+    texts.push_back(keyOf(match));
+    while (int(texts.size()) - staleTexts > textBudget) {
+        auto node = results.value(texts.front());
+        texts.pop_front();
+        if (node && node->textOffset < 0 && node != match)
+            dropText(node);
+        else if (staleTexts > 0)
+            --staleTexts;
+    }
+}
+
+// A row that is going counts as stale in the queue if it holds its text.
+void ResultStorePrivate::forgetText(const ResultNode *match)
+{
+    if (textBudget >= 0 && match->textOffset < 0 && !bufferFiles.contains(match->file))
+        ++staleTexts;
+}
+
+void ResultStorePrivate::purgeTexts()
+{
+    std::deque<ResultKey> live;
+    QSet<const ResultNode *> queued;
+    for (const auto &key : texts) {
+        auto node = results.value(key);
+        if (node && node->textOffset < 0 && !queued.contains(node)) {
+            queued.insert(node);
+            live.push_back(key);
+        }
+    }
+    texts.swap(live);
+    staleTexts = 0;
+}
+
+// The text starts where the line does: the match's byte offset less the bytes
+// of the text before the match's first column.
+void ResultStorePrivate::dropText(ResultNode *match)
+{
+    if (!stamps.contains(match->file))
+        stamps.insert(match->file, stampOf(match->file));
+    match->textOffset = match->byteStart - match->text.left(match->start).toUtf8().size();
+    match->textBytes = match->text.toUtf8().size();
+    bytes -= match->text.size() * sizeof(QChar);
+    match->text = QString();
+}
+
+// Show a context line below a match, reusing the row from the previous run of
+// the search if there is one. Context rows below a match are kept in line order.
+void ResultStorePrivate::attachContext(ResultNode *match, const QString &file, int line)
+{
+    int row = 0;
+    for (; row < match->children.size(); ++row) {
+        auto child = match->children.at(row);
+        if (child->line > line)
+            break;
+        if (child->line < line)
+            continue;
+        seen.insert(child);
+        // The row reads its text from the store, so tell the listener if the
+        // line reads differently now than it did in the previous run.
+        const ContextLine *before = nullptr;
+        if (auto previous = previousContext.constFind(file); previous != previousContext.constEnd()) {
+            if (auto it = previous->constFind(line); it != previous->constEnd())
+                before = &it.value();
+        }
+        auto current = contextLine(file, line);
+        if (!before || !current || before->text != current->text)
+            changed(child);
+        return;
+    }
+
+    auto node = new ResultNode;
+    node->kind = ResultNode::Context;
+    node->file = match->file;
+    node->line = line;
+    insertChild(match, row, node);
+    if (merging)
+        seen.insert(node);
+}
+
+void ResultStorePrivate::updateFileState(ResultNode *file)
+{
+    int checked = 0;
+    for (auto match : std::as_const(file->children)) {
+        if (match->checkState == Qt::Checked)
+            checked++;
+    }
+    const int total = file->children.size();
+    auto state = checked == 0 ? Qt::Unchecked : (checked == total ? Qt::Checked : Qt::PartiallyChecked);
+    if (file->checkState == state)
+        return;
+    file->checkState = state;
+    changed(file);
+}
+
+void ResultStore::setCheckState(ResultNode *node, Qt::CheckState state)
+{
+    switch (node->kind) {
+    case ResultNode::File:
+        // A file's own state is derived from its matches; setting it sets all
+        // of them.
+        if (state == Qt::PartiallyChecked)
+            return;
+        node->checkState = state;
+        d->changed(node);
+        for (auto match : std::as_const(node->children))
+            match->checkState = state;
+        if (d->listener && !node->children.isEmpty())
+            d->listener->rowsChanged(node, 0, node->children.size() - 1);
+        break;
+    case ResultNode::Match:
+        if (node->checkState == state)
+            return;
+        node->checkState = state;
+        d->changed(node);
+        d->updateFileState(node->parent);
+        break;
+    default:
+        break;
+    }
+}
+
+void ResultStore::selectAll()
+{
+    for (auto file : std::as_const(d->root.children))
+        setCheckState(file, Qt::Checked);
+}
+
+void ResultStore::deselectAll()
+{
+    for (auto file : std::as_const(d->root.children))
+        setCheckState(file, Qt::Unchecked);
+}
+
+void ResultStore::invertSelection()
+{
+    // Flip every match, then settle each file's state once rather than after
+    // every single match.
+    for (auto file : std::as_const(d->root.children)) {
+        for (auto match : std::as_const(file->children))
+            match->checkState = match->checkState == Qt::Checked ? Qt::Unchecked : Qt::Checked;
+        if (d->listener && !file->children.isEmpty())
+            d->listener->rowsChanged(file, 0, file->children.size() - 1);
+        d->updateFileState(file);
+    }
+}
+
+QVector<ReplacementTarget> ResultStore::checkedResults() const
+{
+    QVector<ReplacementTarget> result;
+    for (auto file : std::as_const(d->root.children)) {
+        for (auto match : std::as_const(file->children)) {
+            if (match->checkState == Qt::Unchecked)
+                continue;
+            result.append({match->file, match->byteStart, match->byteEnd});
+        }
+    }
+    return result;
+}
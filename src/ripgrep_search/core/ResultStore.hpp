@@ -0,0 +1,172 @@
+#pragma once
+#include <QList>
+#include <QScopedPointer>
+#include <QSet>
+#include <QString>
+#include <QVector>
+
+class LineReader;
+class ResultStorePrivate;
+
+struct ReplacementTarget {
+    QString file;
+    qint64 byteStart;
+    qint64 byteEnd;
+};
+
+// A line around a match. Stored once per file and line, however many matches
+// show it.
+struct ContextLine {
+    QString text;
+    qint64 byteOffset = 0;
+};
+
+// Where the text a match row let go of is in its file, and what the file
+// looked like when it was let go of; enough to read the text back without the
+// store, on another thread even.
+struct DroppedText {
+    QString file;
+    // -1 for a row that holds its text.
+    qint64 offset = -1;
+    int bytes = 0;
+    size_t hash = 0;
+    qint64 modified = -1;
+    qint64 size = -1;
+};
+
+// A row of the result tree: a matched file, a match below it, or a context
+// line below a match.
+struct ResultNode {
+    enum Kind {
+        Root,
+        File,
+        Match,
+        Context,
+    };
+
+    Kind kind = Root;
+    ResultNode *parent = nullptr;
+    QList<ResultNode *> children;
+    // Row within the parent as of the last lookup; see ResultStore::rowOf().
+    mutable int rowHint = 0;
+    QString file;
+    // File rows: the file name. Match rows: ripgrep's line text (every line
+    // the match spans in multiline mode), null once the store let go of it;
+    // read it through ResultStore::matchText(). Context rows read their text
+    // from the store instead.
+    QString text;
+    size_t textHash = 0;
+    // Match rows whose text was let go of: where the text starts in the file
+    // and how many bytes it is there. -1 while the text is held.
+    qint64 textOffset = -1;
+    int textBytes = 0;
+    // Match rows: line number and the match's character columns in text, plus
+    // its absolute UTF-8 byte range in the file (the source of truth for
+    // navigation). Context rows: the line number only.
+    int line = 0;
+    int start = 0;
+    int end = 0;
+    qint64 byteStart = 0;
+    qint64 byteEnd = 0;
+    Qt::CheckState checkState = Qt::Checked;
+    // File rows: the key files are ordered by and, once needed, the file's
+    // modification time.
+    QString sortKey;
+    qint64 modified = -1;
+};
+
+// Told about every change to a ResultStore's tree, in the same begin/end
+// pairs a QAbstractItemModel has to announce them in.
+class ResultStoreListener
+{
+public:
+    virtual ~ResultStoreListener() = default;
+    virtual void rowsAboutToBeInserted(ResultNode *parent, int first, int last) = 0;
+    virtual void rowsInserted() = 0;
+    virtual void rowsAboutToBeRemoved(ResultNode *parent, int first, int last) = 0;
+    virtual void rowsRemoved() = 0;
+    virtual void rowsChanged(ResultNode *parent, int first, int last) = 0;
+    virtual void layoutAboutToBeChanged() = 0;
+    virtual void layoutChanged() = 0;
+    virtual void aboutToReset() = 0;
+    virtual void reset() = 0;
+};
+
+// The results of a search as a tree of files, matches and context lines,
+// independent of any view. Fed from RipgrepCommand's signals.
+//
+// A re-run of the same search is merged into the existing tree instead of
+// rebuilding it: matches are keyed by (file, byte offset, line text), rows
+// that are reported again are kept untouched (with their check state), new
+// ones are inserted in place and whatever was not reported again is removed by
+// endMerge().
+//
+// With a text budget set, only that many match rows hold their line text; the
+// text of the rows that got theirs first is let go of, to be read back from
+// the file whenever it is asked for. Reading it back does not make the row
+// hold it again; what shows the rows keeps what it read for those on screen.
+class ResultStore
+{
+public:
+    // How the matched files are ordered. The matches below a file always
+    // follow their order in the file.
+    enum SortOrder {
+        SortByPath,
+        SortByMatchCount,
+        SortByModified,
+    };
+
+    ResultStore();
+    ~ResultStore();
+
+    void setListener(ResultStoreListener *listener);
+
+    ResultNode *root() const;
+    int rowOf(const ResultNode *node) const;
+    int fileCount() const;
+    int matchCount() const;
+    // An estimate of the memory the results take, in bytes.
+    qint64 memoryUsage() const;
+
+    void clear();
+    void beginMerge();
+    // A merge of a search over the given files only: the results in every
+    // other file are kept as they are.
+    void beginMerge(const QSet<QString> &files);
+    void endMerge();
+
+    void addFile(const QString &file);
+    void addMatch(const QString &file, const QString &text, int line, int start, int end, qint64 byteStart, qint64 byteEnd);
+    void addContext(const QString &file, const QString &text, int line, qint64 byteOffset);
+
+    // How many lines before and after each match the search reports, so that
+    // a context line can be placed below the match(es) it belongs to.
+    void setContextLines(int before, int after);
+    const ContextLine *contextLine(const ResultNode *node) const;
+
+    // A match row's line text, read back from its file if the store let go of
+    // it. Null if the file has changed since.
+    QString matchText(const ResultNode *node) const;
+    // Where to read a row's text back from, for readText().
+    DroppedText droppedText(const ResultNode *node) const;
+    // A text the store let go of, read back through reader; null if the file
+    // has changed since.
+    static QString readText(const DroppedText &text, LineReader *reader);
+    // How many match rows hold their text; -1 (the default) for all of them.
+    void setTextBudget(int rows);
+    // Files whose results come from unsaved buffers rather than the file on
+    // disk, so their rows always hold their text.
+    void setBufferFiles(const QSet<QString> &files);
+
+    SortOrder sortOrder() const;
+    void setSortOrder(SortOrder order);
+
+    void setCheckState(ResultNode *node, Qt::CheckState state);
+    void selectAll();
+    void deselectAll();
+    void invertSelection();
+    QVector<ReplacementTarget> checkedResults() const;
+
+private:
+    const QScopedPointer<ResultStorePrivate> d;
+};
@@ -0,0 +1,566 @@
+#include "RipgrepCommand.hpp"
+#include "RipgrepJsonParser.hpp"
+#include "SearchScheduler.hpp"
+#include "SearchTimeline.hpp"
+
+#include <QDebug>
+#include <QDir>
+#include <QPointer>
+#include <QProcess>
+#include <QSet>
+#include <QThread>
+
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+struct SearchOptions {
+    bool wholeWord = false;
+    bool caseSensitive = false;
+    bool useRegex = false;
+    bool multiline = false;
+    int contextBefore = 0;
+    int contextAfter = 0;
+    QStringList includeFiles;
+    QStringList excludeFiles;
+};
+
+// One rg process of a search. A search over an explicit file list is split
+// into shards run by a small pool of processes; unsaved buffers get one process
+// each, fed through stdin.
+struct SearchJob {
+    QProcess *process = nullptr;
+    QStringList args;
+    // For in-memory buffers: the name results are reported under (ripgrep
+    // itself only sees "<stdin>") and the contents to feed it.
+    QString label;
+    QByteArray input;
+    // Position among the shards of a file list, whose output is released in
+    // shard order; -1 for jobs whose output is reported as it arrives.
+    int shard = -1;
+    // Output of a shard that is not yet released, kept until the shards
+    // before it have finished.
+    QList<QByteArray> held;
+    QString error;
+    // What to pass as --threads when the command has no scheduler, 0 for
+    // nothing.
+    int threads = 0;
+    // When the process was started, on the search's timeline.
+    qint64 started = 0;
+    bool summaryReceived = false;
+    bool done = false;
+};
+
+struct RipgrepCommandPrivate {
+    QStringList buildArgs(const QString &term) const;
+    void parseMatch(SearchJob *job, const QByteArray &match);
+    void search(const QString &term, const QStringList &dirs, const QStringList &files);
+    void startQueued();
+    void start(SearchJob *job);
+    void drain(SearchJob *job);
+    void finish(SearchJob *job, const QString &message);
+    void releaseShards();
+    void account(SearchJob *job);
+    void stop();
+
+    RipgrepCommand *q;
+    QString program;
+    QPointer<SearchScheduler> scheduler;
+    bool background = false;
+    SearchOptions options;
+    SearchTimeline timeline;
+    QList<SearchJob *> jobs;
+    QList<SearchJob *> shards;
+    QList<SearchBuffer> buffers;
+    // Files whose on-disk results are dropped because an in-memory buffer
+    // stands in for them.
+    QSet<QString> bufferFiles;
+    int maxRunning = 1;
+    int nextJob = 0;
+    int running = 0;
+    int remaining = 0;
+    int releasedShard = 0;
+    int found = 0;
+    qint64 nanos = 0;
+    bool failed = false;
+    QString failure;
+};
+
+RipgrepCommand::RipgrepCommand(QObject *parent)
+    : QObject(parent)
+    , d(new RipgrepCommandPrivate)
+{
+    d->q = this;
+    d->program = defaultProgram();
+}
+
+RipgrepCommand::~RipgrepCommand()
+{
+    d->stop();
+}
+
+QString RipgrepCommand::program() const
+{
+    return d->program;
+}
+
+void RipgrepCommand::setProgram(const QString &program)
+{
+    d->program = program;
+}
+
+QString RipgrepCommand::defaultProgram()
+{
+    return qEnvironmentVariable("RIPGREP_SEARCH_RG", QStringLiteral("rg"));
+}
+
+void RipgrepCommand::setScheduler(SearchScheduler *scheduler)
+{
+    if (d->scheduler)
+        disconnect(d->scheduler, nullptr, this, nullptr);
+    d->scheduler = scheduler;
+    // Queued, as a slot is freed while another command is stopping or
+    // finishing a process.
+    if (scheduler) {
+        connect(
+            scheduler,
+            &SearchScheduler::slotFreed,
+            this,
+            [this] {
+                d->startQueued();
+            },
+            Qt::QueuedConnection);
+    }
+}
+
+bool RipgrepCommand::isBackground() const
+{
+    return d->background;
+}
+
+void RipgrepCommand::setBackground(bool background)
+{
+    d->background = background;
+}
+
+SearchTimeline *RipgrepCommand::timeline() const
+{
+    return &d->timeline;
+}
+
+void RipgrepCommand::setWholeWord(bool newValue)
+{
+    d->options.wholeWord = newValue;
+    emit searchOptionsChanged();
+}
+
+void RipgrepCommand::setCaseSensitive(bool newValue)
+{
+    d->options.caseSensitive = newValue;
+    emit searchOptionsChanged();
+}
+
+void RipgrepCommand::setUseRegex(bool newValue)
+{
+    d->options.useRegex = newValue;
+    emit searchOptionsChanged();
+}
+
+void RipgrepCommand::setMultiline(bool newValue)
+{
+    d->options.multiline = newValue;
+    emit searchOptionsChanged();
+}
+
+void RipgrepCommand::setContextLines(int before, int after)
+{
+    if (d->options.contextBefore == before && d->options.contextAfter == after)
+        return;
+    d->options.contextBefore = before;
+    d->options.contextAfter = after;
+    emit searchOptionsChanged();
+}
+
+void RipgrepCommand::setIncludeFiles(const QStringList &files)
+{
+    d->options.includeFiles = files;
+}
+
+void RipgrepCommand::setExcludeFiles(const QStringList &files)
+{
+    d->options.excludeFiles = files;
+}
+
+void RipgrepCommand::setBuffers(const QList<SearchBuffer> &buffers)
+{
+    d->buffers = buffers;
+    d->bufferFiles.clear();
+    for (const auto &buffer : buffers)
+        d->bufferFiles.insert(QDir::cleanPath(buffer.label));
+}
+
+QStringList RipgrepCommandPrivate::buildArgs(const QString &term) const
+{
+    QStringList args;
+    if (options.wholeWord)
+        args << "--word-regexp";
+    if (options.caseSensitive)
+        args << "--case-sensitive";
+    else
+        args << "--ignore-case";
+    if (!options.useRegex)
+        args << "--fixed-strings";
+    if (options.multiline)
+        args << "--multiline";
+    if (options.contextBefore > 0)
+        args << "--before-context" << QString::number(options.contextBefore);
+    if (options.contextAfter > 0)
+        args << "--after-context" << QString::number(options.contextAfter);
+    for (const auto &file : options.includeFiles)
+        args << "--glob" << file;
+    for (const auto &file : options.excludeFiles)
+        args << "--glob" << QString("!%1").arg(file);
+    args << "--json" << "--regexp" << term;
+    return args;
+}
+
+void RipgrepCommandPrivate::stop()
+{
+    for (auto job : std::as_const(jobs)) {
+        if (!job->process)
+            continue;
+        if (scheduler && !job->done)
+            scheduler->release();
+        // A superseded run must not report its own end.
+        QObject::disconnect(job->process, nullptr, q, nullptr);
+        if (job->process->state() != QProcess::NotRunning) {
+            job->process->terminate();
+            job->process->waitForFinished();
+        }
+        job->process->deleteLater();
+    }
+    qDeleteAll(jobs);
+    jobs.clear();
+    shards.clear();
+    if (scheduler)
+        scheduler->cancel(q);
+    nextJob = 0;
+    running = 0;
+    remaining = 0;
+    releasedShard = 0;
+}
+
+// Split an explicit file list so that no command line comes near ARG_MAX and
+// the pool has one shard per process to work on. Short lists stay whole: below
+// a few dozen files another spawn costs more than it saves.
+static QList<QStringList> shardFiles(const QStringList &files, int processes)
+{
+    constexpr int minFiles = 64;
+    constexpr int maxFiles = 1024;
+    constexpr qsizetype maxBytes = 128 * 1024;
+    const int perShard = qBound<int>(minFiles, (files.size() + processes - 1) / processes, maxFiles);
+
+    QList<QStringList> result;
+    QStringList shard;
+    qsizetype bytes = 0;
+    for (const auto &file : files) {
+        // Worst case UTF-8 size of the argument plus its terminator.
+        const qsizetype size = file.size() * 3 + 1;
+        if (!shard.isEmpty() && (shard.size() >= perShard || bytes + size > maxBytes)) {
+            result.append(shard);
+            shard.clear();
+            bytes = 0;
+        }
+        shard.append(file);
+        bytes += size;
+    }
+    if (!shard.isEmpty())
+        result.append(shard);
+    return result;
+}
+
+void RipgrepCommandPrivate::search(const QString &term, const QStringList &dirs, const QStringList &files)
+{
+    stop();
+    timeline.start();
+    found = 0;
+    nanos = 0;
+    failed = false;
+    failure.clear();
+
+    const int cores = std::max(1, QThread::idealThreadCount());
+    // The scheduler's limit, so that the shards of one search can all run at
+    // once when nothing else does.
+    maxRunning = scheduler ? scheduler->maxProcesses() : SearchScheduler::defaultMaxProcesses();
+
+    const auto args = buildArgs(term);
+    if (!dirs.isEmpty()) {
+        qInfo() << "[ripgrep] Searching in directories:" << dirs;
+        // One process walks them all, in parallel, as it does a single one.
+        auto job = new SearchJob;
+        job->args = QStringList(args) << dirs;
+        jobs.append(job);
+    } else if (!files.isEmpty()) {
+        const auto fileShards = shardFiles(files, maxRunning);
+        qInfo() << "[ripgrep] Searching in" << files.size() << "files in" << fileShards.size() << "shards";
+        // Share the cores between the processes that run at the same time
+        // rather than letting each of them start a thread per core.
+        const int threads = std::max(1, cores / std::min<int>(maxRunning, fileShards.size()));
+        for (const auto &shard : fileShards) {
+            auto job = new SearchJob;
+            job->args = QStringList(args) << "--" << shard;
+            if (fileShards.size() > 1)
+                job->threads = threads;
+            job->shard = shards.size();
+            jobs.append(job);
+            shards.append(job);
+        }
+    }
+    for (const auto &buffer : std::as_const(buffers)) {
+        auto job = new SearchJob;
+        job->args = QStringList(args) << "-";
+        job->label = buffer.label;
+        job->input = buffer.contents;
+        jobs.append(job);
+    }
+    if (jobs.isEmpty()) {
+        qInfo() << "[ripgrep] Nothing to search; abort searching";
+        return;
+    }
+    if (!buffers.isEmpty())
+        qInfo() << "[ripgrep] Searching" << buffers.size() << "unsaved buffers in memory";
+
+    remaining = jobs.size();
+    startQueued();
+}
+
+void RipgrepCommandPrivate::startQueued()
+{
+    while (running < maxRunning && nextJob < jobs.size()) {
+        if (scheduler && !scheduler->acquire(q, background))
+            return;
+        start(jobs.at(nextJob++));
+    }
+}
+
+// Run in the child between fork and exec, so async-signal-safe calls only.
+static void lowerPriority()
+{
+#ifdef Q_OS_UNIX
+    setpriority(PRIO_PROCESS, 0, 10);
+#endif
+#if defined(Q_OS_LINUX) && defined(SYS_ioprio_set)
+    // The lowest priority of the best-effort class rather than the idle class,
+    // which a busy disk could starve for good.
+    constexpr int whoProcess = 1;
+    constexpr int classBestEffort = 2;
+    constexpr int classShift = 13;
+    syscall(SYS_ioprio_set, whoProcess, 0, (classBestEffort << classShift) | 7);
+#endif
+}
+
+void RipgrepCommandPrivate::start(SearchJob *job)
+{
+    job->process = new QProcess(q);
+    q->connect(job->process, &QProcess::started, q, [this] {
+        timeline.mark(SearchTimeline::Spawned);
+    });
+    q->connect(job->process, &QProcess::readyReadStandardOutput, q, [this, job] {
+        timeline.mark(SearchTimeline::FirstByte);
+        drain(job);
+    });
+    q->connect(job->process, &QProcess::finished, q, [this, job] {
+        drain(job);
+        finish(job, QString::fromUtf8(job->process->readAllStandardError()).trimmed());
+    });
+    q->connect(job->process, &QProcess::errorOccurred, q, [this, job](QProcess::ProcessError error) {
+        if (error == QProcess::FailedToStart)
+            finish(job, job->process->errorString());
+    });
+
+#ifdef Q_OS_UNIX
+    if (background)
+        job->process->setChildProcessModifier(lowerPriority);
+#endif
+
+    // Processes of other searches may be running alongside, so the cores are
+    // split as the scheduler sees fit at the time.
+    QStringList args;
+    if (const int threads = scheduler ? scheduler->threadsPerProcess() : job->threads; threads > 0)
+        args << "--threads" << QString::number(threads);
+    args << job->args;
+
+    ++running;
+    job->started = timeline.now();
+    if (job->label.isEmpty()) {
+        job->process->start(program, args, QIODevice::ReadOnly);
+    } else {
+        job->process->start(program, args);
+        job->process->write(job->input);
+        job->process->closeWriteChannel();
+    }
+}
+
+void RipgrepCommandPrivate::drain(SearchJob *job)
+{
+    while (job->process->canReadLine()) {
+        auto line = job->process->readLine();
+        if (job->shard > releasedShard)
+            job->held.append(line.trimmed());
+        else
+            parseMatch(job, line.trimmed());
+    }
+}
+
+void RipgrepCommandPrivate::finish(SearchJob *job, const QString &message)
+{
+    if (job->done)
+        return;
+    job->done = true;
+    job->error = message;
+    --running;
+    if (scheduler)
+        scheduler->release();
+    QString name = QStringLiteral("rg");
+    if (!job->label.isEmpty())
+        name = QStringLiteral("rg %1").arg(job->label);
+    else if (job->shard >= 0)
+        name = QStringLiteral("rg shard %1").arg(job->shard + 1);
+    timeline.addProcess(name, job->started, timeline.now());
+    if (job->shard < 0)
+        account(job);
+    else
+        releaseShards();
+
+    startQueued();
+    if (remaining > 0)
+        return;
+    timeline.mark(SearchTimeline::Finished);
+    if (failed)
+        emit q->searchFailed(failure);
+    else
+        emit q->searchFinished(found, nanos);
+}
+
+// Report the held output of every shard whose predecessors have all finished,
+// so results arrive in the order of the file list while the first unfinished
+// shard still streams live.
+void RipgrepCommandPrivate::releaseShards()
+{
+    while (releasedShard < shards.size()) {
+        auto job = shards.at(releasedShard);
+        for (const auto &line : std::as_const(job->held))
+            parseMatch(job, line);
+        job->held.clear();
+        if (!job->done)
+            return;
+        account(job);
+        ++releasedShard;
+    }
+}
+
+void RipgrepCommandPrivate::account(SearchJob *job)
+{
+    --remaining;
+    if (!job->summaryReceived && !failed) {
+        failed = true;
+        failure = job->error;
+    }
+}
+
+void RipgrepCommand::searchInDir(const QString &term, const QString &dir)
+{
+    d->search(term, dir.isEmpty() ? QStringList() : QStringList{dir}, {});
+}
+
+void RipgrepCommand::searchInDirs(const QString &term, const QStringList &dirs)
+{
+    d->search(term, nestedDirsRemoved(dirs), {});
+}
+
+void RipgrepCommand::searchInFiles(const QString &term, const QStringList &files)
+{
+    d->search(term, {}, files);
+}
+
+void RipgrepCommand::stop()
+{
+    d->stop();
+}
+
+QStringList RipgrepCommand::nestedDirsRemoved(const QStringList &dirs)
+{
+    QStringList sorted;
+    for (const auto &dir : dirs) {
+        if (!dir.isEmpty())
+            sorted.append(QDir::cleanPath(dir));
+    }
+    // Sorted, a directory comes before those inside it.
+    std::sort(sorted.begin(), sorted.end());
+    QStringList result;
+    for (const auto &dir : std::as_const(sorted)) {
+        const bool nested = std::any_of(result.cbegin(), result.cend(), [&dir](const QString &outer) {
+            return dir == outer || dir.startsWith(outer.endsWith(QLatin1Char('/')) ? outer : outer + QLatin1Char('/'));
+        });
+        if (!nested)
+            result.append(dir);
+    }
+    return result;
+}
+
+void RipgrepCommandPrivate::parseMatch(SearchJob *job, const QByteArray &match)
+{
+    if (match.isEmpty())
+        return;
+    RipgrepMessage message;
+    QString error;
+    bool parsed;
+    {
+        SearchTimeline::Scope scope(&timeline, SearchTimeline::Parse);
+        parsed = parseRipgrepMessage(match, &message, &error);
+    }
+    if (!parsed) {
+        qWarning() << "JSON Parse Error:" << error;
+        return;
+    }
+
+    QString file;
+    if (message.type == RipgrepMessage::Begin || message.type == RipgrepMessage::Match || message.type == RipgrepMessage::Context) {
+        file = job->label;
+        if (file.isEmpty()) {
+            file = message.path;
+            // An unsaved buffer searched in memory supersedes its file.
+            if (!bufferFiles.isEmpty() && bufferFiles.contains(QDir::cleanPath(file)))
+                return;
+        }
+    }
+
+    switch (message.type) {
+    case RipgrepMessage::Begin:
+        emit q->matchFoundInFile(file);
+        break;
+    case RipgrepMessage::Match:
+        timeline.mark(SearchTimeline::FirstResult);
+        for (const auto &submatch : std::as_const(message.submatches))
+            emit q->matchFound(file, message.text, message.line, submatch.start, submatch.end, submatch.byteStart, submatch.byteEnd);
+        break;
+    case RipgrepMessage::Context:
+        emit q->contextFound(file, message.text, message.line, message.absoluteOffset);
+        break;
+    case RipgrepMessage::Summary:
+        // The jobs of a search run side by side, so report the slowest one.
+        job->summaryReceived = true;
+        found += message.matches;
+        nanos = std::max(nanos, message.elapsedNanos);
+        timeline.addRipgrepStats(message.elapsedNanos, message.bytesSearched, message.filesSearched, message.filesMatched);
+        break;
+    default:
+        break;
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <QObject>
+#include <QProcess>
+
+class RipgrepCommandPrivate;
+class SearchScheduler;
+class SearchTimeline;
+
+// An in-memory document searched instead of its file on disk (or in place of a
+// file at all, for untitled documents). Results are reported under label.
+struct SearchBuffer {
+    QString label;
+    QByteArray contents;
+};
+
+class RipgrepCommand : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RipgrepCommand(QObject *parent);
+    ~RipgrepCommand();
+
+    // Buffers to search alongside the next searches; on-disk results for a file
+    // whose path equals a buffer's label are dropped in favour of the buffer's.
+    void setBuffers(const QList<SearchBuffer> &buffers);
+
+    // The ripgrep executable to run, a name looked up on PATH or a path to it.
+    // Defaults to defaultProgram().
+    QString program() const;
+    void setProgram(const QString &program);
+    // $RIPGREP_SEARCH_RG when set, e.g. to the fake_rg stand-in for load
+    // testing, and "rg" otherwise.
+    static QString defaultProgram();
+    // dirs, cleaned, without those inside another one of them, which rg would
+    // otherwise walk (and report) twice.
+    static QStringList nestedDirsRemoved(const QStringList &dirs);
+
+    // Where to take turns with other commands in starting processes; without
+    // one the command only limits its own processes.
+    void setScheduler(SearchScheduler *scheduler);
+    // Whether the next searches are ones no one is waiting for, run after the
+    // searches that are and at a lower CPU and I/O priority.
+    bool isBackground() const;
+    void setBackground(bool background);
+
+    // The timeline of the current (or last) search. It is restarted by every
+    // search; whoever shows the results adds their own costs to it.
+    SearchTimeline *timeline() const;
+
+public slots:
+    void searchInDir(const QString &term, const QString &dir);
+    // Walks all of dirs in one rg process; see nestedDirsRemoved().
+    void searchInDirs(const QString &term, const QStringList &dirs);
+    void searchInFiles(const QString &term, const QStringList &files);
+    // Ends the current search, if any, without it reporting anything more.
+    void stop();
+
+    void setWholeWord(bool newValue);
+    void setCaseSensitive(bool newValue);
+    void setUseRegex(bool newValue);
+    void setMultiline(bool newValue);
+    void setContextLines(int before, int after);
+    void setIncludeFiles(const QStringList &files);
+    void setExcludeFiles(const QStringList &files);
+
+signals:
+    void matchFoundInFile(const QString &file);
+    // line/start/end describe ripgrep's view of the match (used only for the
+    // result row's text and tooltip); in multiline mode text holds every line
+    // the match spans and start/end are offsets into all of it.
+    // byteStart/byteEnd are absolute UTF-8 byte offsets into the file; they
+    // are the source of truth for navigation, since ripgrep and Kate disagree
+    // on line boundaries when a lone '\r' is present.
+    void matchFound(const QString &file, const QString &text, int line, int start, int end, qint64 byteStart, qint64 byteEnd);
+    // A line around a match, reported once even when it is in the context of
+    // several matches. byteOffset is the absolute offset of the line's start.
+    void contextFound(const QString &file, const QString &text, int line, qint64 byteOffset);
+    void searchFinished(int found, qint64 nanos);
+    // ripgrep exited (or never started) without reporting a summary, e.g.
+    // because the pattern is not a valid regular expression.
+    void searchFailed(const QString &message);
+    void searchOptionsChanged();
+
+private:
+    const QScopedPointer<RipgrepCommandPrivate> d;
+};
@@ -0,0 +1,118 @@
+#include "RipgrepJsonParser.hpp"
+
+#include <QException>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+struct JsonResolutionError : public QException {
+    QString message;
+    JsonResolutionError(const QString &message)
+        : message(message)
+    {
+    }
+};
+
+// Ripgrep reports submatch offsets as UTF-8 byte offsets, but KTextEditor
+// cursors and ranges use character (UTF-16 code unit) offsets. These diverge
+// whenever the line contains multi-byte characters such as CJK text, so we map
+// a byte offset back to the corresponding character offset in the line.
+static int byteOffsetToCharOffset(const QByteArray &utf8Line, int byteOffset)
+{
+    byteOffset = qBound(0, byteOffset, utf8Line.size());
+    return QString::fromUtf8(utf8Line.constData(), byteOffset).size();
+}
+
+static QJsonValue resolveJson(const QJsonObject &root, const QStringList &args)
+{
+    Q_ASSERT(args.size() > 0);
+    QJsonObject obj = root;
+    QJsonValue value;
+    for (const auto &key : args) {
+        value = obj.value(key);
+        if (value == QJsonValue::Undefined)
+            throw JsonResolutionError(QStringLiteral("%1 is undefined").arg(key));
+        if (&key != &args.back())
+            obj = value.toObject();
+    }
+    return value;
+}
+
+static RipgrepMessage::Type messageType(const QString &type)
+{
+    if (type == QLatin1String("match"))
+        return RipgrepMessage::Match;
+    if (type == QLatin1String("context"))
+        return RipgrepMessage::Context;
+    if (type == QLatin1String("begin"))
+        return RipgrepMessage::Begin;
+    if (type == QLatin1String("end"))
+        return RipgrepMessage::End;
+    if (type == QLatin1String("summary"))
+        return RipgrepMessage::Summary;
+    return RipgrepMessage::Unknown;
+}
+
+bool parseRipgrepMessage(const QByteArray &line, RipgrepMessage *message, QString *error)
+{
+    *message = RipgrepMessage();
+    try {
+        QJsonParseError err;
+        auto json = QJsonDocument::fromJson(line, &err);
+        if (err.error != QJsonParseError::NoError)
+            throw JsonResolutionError(err.errorString());
+        auto root = json.object();
+        message->type = messageType(resolveJson(root, {"type"}).toString());
+        auto data = resolveJson(root, {"data"}).toObject();
+        switch (message->type) {
+        case RipgrepMessage::Begin:
+        case RipgrepMessage::End:
+            message->path = resolveJson(data, {"path", "text"}).toString();
+            break;
+        case RipgrepMessage::Match:
+        case RipgrepMessage::Context: {
+            message->path = resolveJson(data, {"path", "text"}).toString();
+            message->text = resolveJson(data, {"lines", "text"}).toString();
+            message->line = resolveJson(data, {"line_number"}).toInt();
+            // Byte offset in the file of the start of this (ripgrep) line, so we
+            // can hand downstream the absolute byte position of each submatch.
+            message->absoluteOffset = data.value("absolute_offset").toInteger();
+            if (message->type == RipgrepMessage::Context)
+                break;
+            auto utf8Line = message->text.toUtf8();
+            auto submatches = resolveJson(data, {"submatches"}).toArray();
+            message->submatches.reserve(submatches.size());
+            for (auto v : submatches) {
+                auto obj = v.toObject();
+                int startByte = resolveJson(obj, {"start"}).toInt();
+                int endByte = resolveJson(obj, {"end"}).toInt();
+                message->submatches.append({
+                    byteOffsetToCharOffset(utf8Line, startByte),
+                    byteOffsetToCharOffset(utf8Line, endByte),
+                    message->absoluteOffset + startByte,
+                    message->absoluteOffset + endByte,
+                });
+            }
+            break;
+        }
+        case RipgrepMessage::Summary: {
+            message->matches = resolveJson(data, {"stats", "matches"}).toInt();
+            message->elapsedNanos = resolveJson(data, {"elapsed_total", "nanos"}).toInteger();
+            // Only informative, so not required.
+            auto stats = data.value("stats").toObject();
+            message->bytesSearched = stats.value("bytes_searched").toInteger();
+            message->filesSearched = stats.value("searches").toInteger();
+            message->filesMatched = stats.value("searches_with_match").toInteger();
+            break;
+        }
+        case RipgrepMessage::Unknown:
+            break;
+        }
+    } catch (JsonResolutionError &err) {
+        if (error)
+            *error = err.message;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+struct RipgrepSubmatch {
+    // Character (UTF-16 code unit) offsets into the message's text.
+    int start = 0;
+    int end = 0;
+    // Absolute UTF-8 byte offsets into the searched file.
+    qint64 byteStart = 0;
+    qint64 byteEnd = 0;
+};
+
+// One line of `rg --json` output, reduced to what the plugin uses.
+struct RipgrepMessage {
+    enum Type {
+        Unknown,
+        Begin,
+        Match,
+        Context,
+        End,
+        Summary,
+    };
+
+    Type type = Unknown;
+    // Begin, match, context and end messages.
+    QString path;
+    // Match and context messages: the line(s) as ripgrep reports them, their
+    // (first) line number and the absolute byte offset of their start.
+    QString text;
+    int line = 0;
+    qint64 absoluteOffset = 0;
+    QList<RipgrepSubmatch> submatches;
+    // Summary message.
+    int matches = 0;
+    qint64 elapsedNanos = 0;
+    qint64 bytesSearched = 0;
+    qint64 filesSearched = 0;
+    qint64 filesMatched = 0;
+};
+
+// Parse a single line of ripgrep's JSON output. Returns false, with a
+// description of the problem in error, when the line is not a well-formed
+// message.
+bool parseRipgrepMessage(const QByteArray &line, RipgrepMessage *message, QString *error = nullptr);
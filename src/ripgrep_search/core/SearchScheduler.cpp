@@ -0,0 +1,84 @@
+#include "SearchScheduler.hpp"
+
+#include <QList>
+#include <QThread>
+
+#include <algorithm>
+
+class SearchSchedulerPrivate
+{
+public:
+    int cores = 1;
+    int maxProcesses = 2;
+    int running = 0;
+    // Owners that were refused a slot, in the order they asked.
+    QList<const QObject *> waitingForeground;
+    QList<const QObject *> waitingBackground;
+};
+
+SearchScheduler::SearchScheduler(QObject *parent)
+    : QObject(parent)
+    , d(new SearchSchedulerPrivate)
+{
+    d->cores = std::max(1, QThread::idealThreadCount());
+    d->maxProcesses = defaultMaxProcesses();
+}
+
+SearchScheduler::~SearchScheduler() = default;
+
+int SearchScheduler::maxProcesses() const
+{
+    return d->maxProcesses;
+}
+
+void SearchScheduler::setMaxProcesses(int processes)
+{
+    d->maxProcesses = std::max(1, processes);
+    emit slotFreed();
+}
+
+int SearchScheduler::running() const
+{
+    return d->running;
+}
+
+int SearchScheduler::defaultMaxProcesses()
+{
+    return qBound(2, QThread::idealThreadCount() / 2, 8);
+}
+
+bool SearchScheduler::acquire(const QObject *owner, bool background)
+{
+    auto &waiting = background ? d->waitingBackground : d->waitingForeground;
+    const bool free = d->running < d->maxProcesses && (!background || d->waitingForeground.isEmpty());
+    if (!free) {
+        if (!waiting.contains(owner))
+            waiting.append(owner);
+        return false;
+    }
+    waiting.removeOne(owner);
+    ++d->running;
+    return true;
+}
+
+void SearchScheduler::release()
+{
+    if (d->running > 0)
+        --d->running;
+    if (!d->waitingForeground.isEmpty() || !d->waitingBackground.isEmpty())
+        emit slotFreed();
+}
+
+void SearchScheduler::cancel(const QObject *owner)
+{
+    d->waitingForeground.removeOne(owner);
+    d->waitingBackground.removeOne(owner);
+}
+
+int SearchScheduler::threadsPerProcess() const
+{
+    const int busy = std::min(d->maxProcesses, d->running);
+    if (busy <= 1)
+        return 0;
+    return std::max(1, d->cores / busy);
+}
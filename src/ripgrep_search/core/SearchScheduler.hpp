@@ -0,0 +1,48 @@
+#pragma once
+#include <QObject>
+#include <QScopedPointer>
+
+class SearchSchedulerPrivate;
+
+// Shares the machine between the rg processes of every search that uses it
+// (see RipgrepCommand::setScheduler()): no more than a few run at once, the
+// cores are split between them rather than each starting a thread per core,
+// and background searches (re-runs no one is waiting for) only get to start a
+// process while no foreground search is waiting for one.
+class SearchScheduler : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SearchScheduler(QObject *parent = nullptr);
+    ~SearchScheduler();
+
+    // How many processes may run at once; defaultMaxProcesses() unless set
+    // otherwise. A command splits its files into this many shards at most.
+    int maxProcesses() const;
+    void setMaxProcesses(int processes);
+    int running() const;
+    // Half the cores, but 2 to 8; also the limit of a command without a
+    // scheduler.
+    static int defaultMaxProcesses();
+
+    // Takes a slot for one process of owner. When none is free (or, for a
+    // background owner, when a foreground one is waiting), owner is noted as
+    // waiting, false is returned and slotFreed() tells when to try again.
+    bool acquire(const QObject *owner, bool background);
+    // Gives back a slot taken by acquire().
+    void release();
+    // owner does not want a slot any more.
+    void cancel(const QObject *owner);
+
+    // What to pass as --threads to a process that has just taken its slot:
+    // the cores split between the processes running, or 0 to leave it to rg
+    // when there is only the one. Owners still waiting for a slot do not
+    // count; they run once others are done.
+    int threadsPerProcess() const;
+
+signals:
+    void slotFreed();
+
+private:
+    const QScopedPointer<SearchSchedulerPrivate> d;
+};
@@ -0,0 +1,201 @@
+#include "SearchTimeline.hpp"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+
+#include <algorithm>
+
+// Costs are incurred once per message, result or row, far too often to keep a
+// slice for each. A cost starting within this long of the end of the previous
+// one extends its slice instead, and no more slices than this are kept.
+static constexpr qint64 sliceGap = 200 * 1000;
+static constexpr qsizetype maxSlices = 100 * 1000;
+
+static QString milliseconds(qint64 nanos)
+{
+    return nanos < 0 ? QStringLiteral("-") : SearchTimeline::tr("%1 ms").arg(nanos / 1e6, 0, 'f', 1);
+}
+
+static QString megabytes(qint64 bytes)
+{
+    return SearchTimeline::tr("%1 MB").arg(bytes / 1e6, 0, 'f', 1);
+}
+
+static const char *costName(int cost)
+{
+    switch (cost) {
+    case SearchTimeline::Parse:
+        return "parse";
+    case SearchTimeline::Insert:
+        return "insert";
+    case SearchTimeline::Paint:
+        return "paint";
+    }
+    return "";
+}
+
+SearchTimeline::Scope::Scope(SearchTimeline *timeline, Cost cost)
+    : m_timeline(timeline && timeline->isStarted() ? timeline : nullptr)
+    , m_cost(cost)
+    , m_start(m_timeline ? m_timeline->now() : 0)
+{
+}
+
+SearchTimeline::Scope::~Scope()
+{
+    if (m_timeline)
+        m_timeline->addCost(m_cost, m_start, m_timeline->now());
+}
+
+SearchTimeline::SearchTimeline()
+{
+    std::fill(std::begin(m_marks), std::end(m_marks), -1);
+    std::fill(std::begin(m_costTime), std::end(m_costTime), 0);
+    std::fill(std::begin(m_costCount), std::end(m_costCount), 0);
+    std::fill(std::begin(m_lastSlice), std::end(m_lastSlice), -1);
+}
+
+void SearchTimeline::start()
+{
+    *this = SearchTimeline();
+    m_timer.start();
+}
+
+bool SearchTimeline::isStarted() const
+{
+    return m_timer.isValid();
+}
+
+qint64 SearchTimeline::now() const
+{
+    return m_timer.isValid() ? m_timer.nsecsElapsed() : 0;
+}
+
+void SearchTimeline::mark(Mark mark)
+{
+    if (isStarted() && m_marks[mark] < 0)
+        m_marks[mark] = now();
+}
+
+qint64 SearchTimeline::markTime(Mark mark) const
+{
+    return m_marks[mark];
+}
+
+void SearchTimeline::addCost(Cost cost, qint64 start, qint64 end)
+{
+    m_costTime[cost] += end - start;
+    ++m_costCount[cost];
+
+    const qsizetype last = m_lastSlice[cost];
+    if (last >= 0 && start - m_slices.at(last).end < sliceGap) {
+        m_slices[last].end = end;
+        return;
+    }
+    if (m_slices.size() >= maxSlices)
+        return;
+    m_lastSlice[cost] = m_slices.size();
+    m_slices.append({cost, start, end, QString::fromLatin1(costName(cost))});
+}
+
+qint64 SearchTimeline::costTime(Cost cost) const
+{
+    return m_costTime[cost];
+}
+
+qint64 SearchTimeline::costCount(Cost cost) const
+{
+    return m_costCount[cost];
+}
+
+void SearchTimeline::addProcess(const QString &name, qint64 start, qint64 end)
+{
+    m_slices.append({CostCount + m_processes++, start, end, name});
+}
+
+void SearchTimeline::addRipgrepStats(qint64 elapsed, qint64 bytesSearched, qint64 filesSearched, qint64 filesMatched)
+{
+    // The processes of a search run side by side, so the slowest one is what
+    // rg took.
+    m_rgElapsed = std::max(m_rgElapsed, elapsed);
+    m_bytesSearched += bytesSearched;
+    m_filesSearched += filesSearched;
+    m_filesMatched += filesMatched;
+}
+
+void SearchTimeline::updateMemory(qint64 bytes)
+{
+    m_peakMemory = std::max(m_peakMemory, bytes);
+}
+
+QString SearchTimeline::summary() const
+{
+    QStringList lines;
+    lines << tr("rg started: %1").arg(milliseconds(m_marks[Spawned]));
+    lines << tr("First output: %1").arg(milliseconds(m_marks[FirstByte]));
+    lines << tr("First result: %1").arg(milliseconds(m_marks[FirstResult]));
+    lines << tr("First result shown: %1").arg(milliseconds(m_marks[FirstResultShown]));
+    lines << tr("Finished: %1").arg(milliseconds(m_marks[Finished]));
+    lines << tr("Parsing: %1 for %2 messages").arg(milliseconds(m_costTime[Parse])).arg(m_costCount[Parse]);
+    lines << tr("Inserting: %1 for %2 rows").arg(milliseconds(m_costTime[Insert])).arg(m_costCount[Insert]);
+    lines << tr("Painting: %1 for %2 rows painted").arg(milliseconds(m_costTime[Paint])).arg(m_costCount[Paint]);
+    lines << tr("rg: %1 in %2 processes, %3 files searched (%4 matched), %5")
+                 .arg(milliseconds(m_rgElapsed))
+                 .arg(m_processes)
+                 .arg(m_filesSearched)
+                 .arg(m_filesMatched)
+                 .arg(megabytes(m_bytesSearched));
+    lines << tr("Peak results memory: %1").arg(megabytes(m_peakMemory));
+    return lines.join(QLatin1Char('\n'));
+}
+
+QByteArray SearchTimeline::toChromeTrace() const
+{
+    auto micros = [](qint64 nanos) {
+        return nanos / 1e3;
+    };
+    auto lane = [](int tid, const QString &name) {
+        return QJsonObject{{"ph", "M"}, {"name", "thread_name"}, {"pid", 1}, {"tid", tid}, {"args", QJsonObject{{"name", name}}}};
+    };
+
+    QJsonArray events;
+    events.append(QJsonObject{{"ph", "M"}, {"name", "process_name"}, {"pid", 1}, {"args", QJsonObject{{"name", "ripgrep search"}}}});
+    events.append(lane(0, QStringLiteral("search")));
+    for (int cost = 0; cost < CostCount; ++cost)
+        events.append(lane(1 + cost, QString::fromLatin1(costName(cost))));
+    for (int process = 0; process < m_processes; ++process)
+        events.append(lane(1 + CostCount + process, QStringLiteral("rg #%1").arg(process + 1)));
+
+    static const char *const markNames[] = {"rg started", "first output", "first result", "first result shown", "finished"};
+    for (int mark = 0; mark < MarkCount; ++mark) {
+        if (m_marks[mark] < 0)
+            continue;
+        events.append(QJsonObject{{"ph", "i"}, {"s", "p"}, {"name", markNames[mark]}, {"pid", 1}, {"tid", 0}, {"ts", micros(m_marks[mark])}});
+    }
+    for (const auto &slice : m_slices) {
+        events.append(QJsonObject{
+            {"ph", "X"},
+            {"name", slice.name},
+            {"pid", 1},
+            {"tid", 1 + slice.lane},
+            {"ts", micros(slice.start)},
+            {"dur", micros(slice.end - slice.start)},
+        });
+    }
+
+    QJsonObject totals;
+    for (int cost = 0; cost < CostCount; ++cost) {
+        totals.insert(QString::fromLatin1(costName(cost)), QJsonObject{{"nanos", m_costTime[cost]}, {"count", m_costCount[cost]}});
+    }
+    const QJsonObject stats{
+        {"costs", totals},
+        {"rg_elapsed_nanos", m_rgElapsed},
+        {"bytes_searched", m_bytesSearched},
+        {"files_searched", m_filesSearched},
+        {"files_matched", m_filesMatched},
+        {"peak_results_memory", m_peakMemory},
+    };
+    return QJsonDocument(QJsonObject{{"traceEvents", events}, {"displayTimeUnit", "ms"}, {"otherData", stats}}).toJson();
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QList>
+#include <QString>
+
+// Where the time of one search goes: when it reached each phase, how long
+// parsing, inserting and painting results took in total, what rg reported
+// having searched and how much memory the results took at most. All times are
+// in nanoseconds since the search started.
+class SearchTimeline
+{
+    Q_DECLARE_TR_FUNCTIONS(SearchTimeline)
+
+public:
+    enum Mark {
+        // The first rg process started.
+        Spawned,
+        // The first output arrived from rg.
+        FirstByte,
+        // The first result was reported.
+        FirstResult,
+        // The first result was painted.
+        FirstResultShown,
+        // The last rg process finished.
+        Finished,
+        MarkCount,
+    };
+
+    enum Cost {
+        Parse,
+        Insert,
+        Paint,
+        CostCount,
+    };
+
+    // Measures a cost for as long as it lives; does nothing without a timeline
+    // or before the timeline has started.
+    class Scope
+    {
+    public:
+        Scope(SearchTimeline *timeline, Cost cost);
+        ~Scope();
+
+    private:
+        SearchTimeline *m_timeline;
+        Cost m_cost;
+        qint64 m_start;
+    };
+
+    SearchTimeline();
+
+    // Forget the previous search and start timing a new one.
+    void start();
+    bool isStarted() const;
+    qint64 now() const;
+
+    // Record that a phase was reached; only the first time counts.
+    void mark(Mark mark);
+    // When a phase was reached, or -1 if it was not (yet).
+    qint64 markTime(Mark mark) const;
+
+    void addCost(Cost cost, qint64 start, qint64 end);
+    qint64 costTime(Cost cost) const;
+    qint64 costCount(Cost cost) const;
+
+    // The lifetime of one rg process of the search.
+    void addProcess(const QString &name, qint64 start, qint64 end);
+    // What one rg process reported in its summary.
+    void addRipgrepStats(qint64 elapsed, qint64 bytesSearched, qint64 filesSearched, qint64 filesMatched);
+    void updateMemory(qint64 bytes);
+
+    // A human readable account of the search, one item per line.
+    QString summary() const;
+    // The search in Chrome's trace event format, for chrome://tracing or
+    // https://ui.perfetto.dev.
+    QByteArray toChromeTrace() const;
+
+private:
+    struct Slice {
+        // A Cost, or one of the process lanes after them.
+        int lane;
+        qint64 start;
+        qint64 end;
+        QString name;
+    };
+
+    QElapsedTimer m_timer;
+    qint64 m_marks[MarkCount];
+    qint64 m_costTime[CostCount];
+    qint64 m_costCount[CostCount];
+    QList<Slice> m_slices;
+    // Index into m_slices of the last slice of each cost, which a cost that
+    // follows it closely extends instead of adding a slice of its own.
+    qsizetype m_lastSlice[CostCount];
+    int m_processes = 0;
+    qint64 m_rgElapsed = 0;
+    qint64 m_bytesSearched = 0;
+    qint64 m_filesSearched = 0;
+    qint64 m_filesMatched = 0;
+    qint64 m_peakMemory = 0;
+};